@@ -0,0 +1,145 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Many threads reading one ready shared_future. Half of the threads
+ * only call get(); the other half copy the shared_future before each
+ * get, writing its reference count. Run it from builds configured with
+ * and without MIN11_PADDED_FUTURE_STATE to compare the readers' cost
+ * with and without the reference count sharing their cache line.
+ *
+ * usage: bench_shared_future_readers [threads] [iterations]
+ */
+
+#include <min11/future.h>
+#include <min11/thread.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	struct shared
+	{
+		min11::shared_future<int> future;
+		unsigned long iterations;
+		volatile long arrived;
+		unsigned threads;
+	};
+
+	struct reader
+	{
+		shared* s;
+		bool copy;
+		unsigned long long* elapsed;
+		long* sum;
+
+		void operator()()
+		{
+			// start together so the readers contend for the whole run
+			min11::detail::atomic_fetch_add(&s->arrived, 1);
+			while (min11::detail::atomic_load(&s->arrived) != static_cast<long>(s->threads))
+				min11::detail::cpu_relax();
+
+			const unsigned long long start = min11::detail::monotonic_milliseconds();
+			long total = 0;
+			if (copy)
+			{
+				for (unsigned long ii = 0; ii < s->iterations; ++ii)
+				{
+					min11::shared_future<int> f(s->future);
+					total += f.get();
+				}
+			}
+			else
+			{
+				const min11::shared_future<int>& f = s->future;
+				for (unsigned long ii = 0; ii < s->iterations; ++ii)
+					total += f.get();
+			}
+
+			*elapsed = min11::detail::monotonic_milliseconds() - start;
+			*sum = total;
+		}
+	};
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threads = min11::thread::hardware_concurrency();
+	if (threads < 2)
+		threads = 2;
+	if (argc > 1)
+		threads = static_cast<unsigned>(std::atoi(argv[1]));
+	const unsigned long iterations = argc > 2 ? std::strtoul(argv[2], 0, 10) : 10000000;
+
+	min11::promise<int> p;
+	shared s;
+	s.future = p.get_future().share();
+	s.iterations = iterations;
+	s.arrived = 0;
+	s.threads = threads;
+	p.set_value(1);
+
+	std::vector<unsigned long long> elapsed(threads);
+	std::vector<long> sums(threads);
+	std::vector<min11::thread*> workers(threads);
+	for (unsigned ii = 0; ii < threads; ++ii)
+	{
+		reader r = {&s, 0 != (ii & 1), &elapsed[ii], &sums[ii]};
+		workers[ii] = new min11::thread(r);
+	}
+
+	for (unsigned ii = 0; ii < threads; ++ii)
+	{
+		workers[ii]->join();
+		delete workers[ii];
+	}
+
+	unsigned long long readers_ms = 0, copiers_ms = 0;
+	for (unsigned ii = 0; ii < threads; ++ii)
+	{
+		if (sums[ii] != static_cast<long>(iterations))
+		{
+			std::fprintf(stderr, "thread %u read %ld, expected %lu\n", ii, sums[ii], iterations);
+			return 1;
+		}
+
+		if (ii & 1)
+			copiers_ms += elapsed[ii];
+		else
+			readers_ms += elapsed[ii];
+	}
+
+	const unsigned readers = (threads + 1) / 2;
+	const unsigned copiers = threads / 2;
+	std::printf("padded=%d threads=%u iterations=%lu\n", MIN11_HAS_PADDED_FUTURE_STATE, threads, iterations);
+	std::printf("  get:        %.2f ns/op\n", 1e6 * readers_ms / (static_cast<double>(readers) * iterations));
+	if (copiers)
+		std::printf("  copy + get: %.2f ns/op\n", 1e6 * copiers_ms / (static_cast<double>(copiers) * iterations));
+	return 0;
+}
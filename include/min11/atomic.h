@@ -0,0 +1,155 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__ATOMIC_H
+#define MIN11__ATOMIC_H
+
+#if !defined(__ATOMIC_ACQUIRE) && defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#	include <intrin.h> // _ReadWriteBarrier
+#endif
+
+namespace min11
+{
+	namespace detail
+	{
+		// Sequentially consistent atomic operations on a long, implemented
+		// by each platform. Read-modify-write operations return the value
+		// held before the operation.
+		long atomic_load(const volatile long* p);
+		void atomic_store(volatile long* p, long value);
+		long atomic_exchange(volatile long* p, long value);
+		long atomic_compare_exchange(volatile long* p, long expected, long desired);
+		long atomic_fetch_add(volatile long* p, long delta);
+
+		// Sequentially consistent atomic operations on a pointer
+		void* atomic_load_ptr(void* const volatile* p);
+		void atomic_store_ptr(void* volatile* p, void* value);
+		void* atomic_exchange_ptr(void* volatile* p, void* value);
+		void* atomic_compare_exchange_ptr(void* volatile* p, void* expected, void* desired);
+
+		// Full memory barrier
+		void atomic_fence();
+
+		// Hint to the processor that the caller is spinning
+		void cpu_relax();
+
+		template<typename T>
+		T* atomic_load(T* const volatile* p)
+		{
+			return static_cast<T*>(atomic_load_ptr(reinterpret_cast<void* const volatile*>(p)));
+		}
+
+		template<typename T>
+		void atomic_store(T* volatile* p, T* value)
+		{
+			atomic_store_ptr(reinterpret_cast<void* volatile*>(p), value);
+		}
+
+		template<typename T>
+		T* atomic_exchange(T* volatile* p, T* value)
+		{
+			return static_cast<T*>(atomic_exchange_ptr(reinterpret_cast<void* volatile*>(p), value));
+		}
+
+		template<typename T>
+		T* atomic_compare_exchange(T* volatile* p, T* expected, T* desired)
+		{
+			return static_cast<T*>(atomic_compare_exchange_ptr(reinterpret_cast<void* volatile*>(p), expected, desired));
+		}
+
+		// Inline loads, stores and fences with weaker ordering, for read
+		// paths where a call per access would cost more than the access.
+		// Compilers without the intrinsics fall back to the calls above.
+#if defined(__ATOMIC_ACQUIRE)
+		static inline long atomic_load_acquire(const volatile long* p)
+		{
+			return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+		}
+
+		static inline long atomic_load_relaxed(const volatile long* p)
+		{
+			return __atomic_load_n(p, __ATOMIC_RELAXED);
+		}
+
+		static inline void atomic_store_relaxed(volatile long* p, long value)
+		{
+			__atomic_store_n(p, value, __ATOMIC_RELAXED);
+		}
+
+		// orders earlier loads before later loads and stores
+		static inline void atomic_fence_acquire()
+		{
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		}
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+		// x86 does not reorder loads with other loads, or stores with
+		// earlier loads; only the compiler must be held back
+		static inline long atomic_load_acquire(const volatile long* p)
+		{
+			const long value = *p;
+			_ReadWriteBarrier();
+			return value;
+		}
+
+		static inline long atomic_load_relaxed(const volatile long* p)
+		{
+			return *p;
+		}
+
+		static inline void atomic_store_relaxed(volatile long* p, long value)
+		{
+			*p = value;
+		}
+
+		static inline void atomic_fence_acquire()
+		{
+			_ReadWriteBarrier();
+		}
+#else
+		static inline long atomic_load_acquire(const volatile long* p)
+		{
+			return atomic_load(p);
+		}
+
+		static inline long atomic_load_relaxed(const volatile long* p)
+		{
+			return *p;
+		}
+
+		static inline void atomic_store_relaxed(volatile long* p, long value)
+		{
+			*p = value;
+		}
+
+		static inline void atomic_fence_acquire()
+		{
+			atomic_fence();
+		}
+#endif
+	}
+}
+
+#endif // MIN11__ATOMIC_H
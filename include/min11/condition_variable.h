@@ -27,14 +27,23 @@
 #ifndef MIN11__CONDITION_VARIABLE_H
 #define MIN11__CONDITION_VARIABLE_H
 
+#include "config.h"
+
 namespace min11
 {
 	class mutex;
+	class pi_mutex;
 	template<typename M> class unique_lock;
-	namespace detail { struct condition_variable_internal; }
+	namespace detail
+	{
+		struct condition_variable_internal;
+		struct condition_fibers;
+	}
 
 	/**
-	 * Minimal emulation for std::condition_variable
+	 * Minimal emulation for std::condition_variable. A fiber (see
+	 * fiber.h) waiting in wait() is suspended rather than blocking its
+	 * worker thread; wait_for still blocks the thread.
 	 */
 	class condition_variable
 	{
@@ -43,6 +52,12 @@ namespace min11
 		~condition_variable();
 
 		void wait(unique_lock<mutex>& lock);
+		void wait(unique_lock<pi_mutex>& lock);
+
+		// as wait(), but give up after `ms' milliseconds without a
+		// notification. Returns false if the wait timed out.
+		bool wait_for(unique_lock<mutex>& lock, unsigned long ms);
+		bool wait_for(unique_lock<pi_mutex>& lock, unsigned long ms);
 
 		void notify_one();
 		void notify_all();
@@ -51,7 +66,12 @@ namespace min11
 		condition_variable(const condition_variable&); // = delete;
 		condition_variable& operator=(const condition_variable&); // = delete;
 		
+#if MIN11_HAS_PARKING_LOT
+		volatile unsigned char has_waiters;
+#else
 		detail::condition_variable_internal* cv;
+#endif
+		detail::condition_fibers* volatile fibers;
 	};
 }
 
@@ -87,6 +87,21 @@
 #	endif
 #endif
 
+/**
+ * MIN11_HAS_EXCEPTION_PTR
+ *
+ * Enables promise::set_exception(std::exception_ptr) and
+ * make_exceptional_future(std::exception_ptr). Defaults to on when both
+ * exceptions and rvalue references are available.
+ */
+#if !defined(MIN11_HAS_EXCEPTION_PTR)
+#	if MIN11_HAS_EXCEPTIONS && MIN11_HAS_RVALREFS
+#		define MIN11_HAS_EXCEPTION_PTR 1
+#	else
+#		define MIN11_HAS_EXCEPTION_PTR 0
+#	endif
+#endif
+
 /**
  * MIN11_HAS_FUTURE_CONTINUATIONS
  *
@@ -97,4 +112,126 @@
 #	define MIN11_HAS_FUTURE_CONTINUATIONS 0
 #endif
 
+/**
+ * MIN11_HAS_COROUTINES
+ *
+ * Enables C++20 coroutine support: futures become awaitable and
+ * min11::task<T> is available as a coroutine return type. Min11 will
+ * attempt to ascertain this value from the compiler.
+ */
+#if !defined(MIN11_HAS_COROUTINES)
+#	if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#		define MIN11_HAS_COROUTINES 1
+#	else
+#		define MIN11_HAS_COROUTINES 0
+#	endif
+#endif
+
+/**
+ * MIN11_CACHE_LINE_SIZE
+ *
+ * Size, in bytes, of a cache line on the target processor. Used to keep
+ * independently written fields from sharing a line.
+ */
+#if !defined(MIN11_CACHE_LINE_SIZE)
+#	define MIN11_CACHE_LINE_SIZE 64
+#endif
+
+/**
+ * MIN11_HAS_PADDED_FUTURE_STATE
+ *
+ * Set to 1 to lay out the state shared by a promise and its futures so that
+ * the reference count, the state's lock, the readiness flags and the stored
+ * value each sit on their own cache line. Copying a shared_future writes the
+ * reference count and blocking waiters write the lock; without padding those
+ * writes invalidate the line every get of a ready state reads.
+ * Costs three extra cache lines per state.
+ */
+#if !defined(MIN11_HAS_PADDED_FUTURE_STATE)
+#	define MIN11_HAS_PADDED_FUTURE_STATE 0
+#endif
+
+/**
+ * MIN11_HAS_IO_REACTOR
+ *
+ * Enables min11::io_reactor, which completes futures as file descriptors
+ * become ready. Requires epoll, so defaults to 1 on Linux only.
+ */
+#if !defined(MIN11_HAS_IO_REACTOR)
+#	if defined(__linux__)
+#		define MIN11_HAS_IO_REACTOR 1
+#	else
+#		define MIN11_HAS_IO_REACTOR 0
+#	endif
+#endif
+
+/**
+ * MIN11_HAS_INTERPROCESS
+ *
+ * Enables min11::shared_memory_arena and the interprocess promise/future,
+ * built on POSIX shared memory and process-shared pthread objects.
+ * Defaults to 1 on Linux only.
+ */
+#if !defined(MIN11_HAS_INTERPROCESS)
+#	if defined(__linux__)
+#		define MIN11_HAS_INTERPROCESS 1
+#	else
+#		define MIN11_HAS_INTERPROCESS 0
+#	endif
+#endif
+
+/**
+ * MIN11_HAS_FIBERS
+ *
+ * Enables min11::fiber_scheduler, which runs tasks as fibers multiplexed
+ * over worker threads, built on ucontext (pthreads) or Win32 fibers.
+ * Defaults to 1 on Linux and Windows; set to 0 on C libraries without
+ * getcontext/makecontext (such as musl).
+ */
+#if !defined(MIN11_HAS_FIBERS)
+#	if defined(__linux__) || defined(_WIN32)
+#		define MIN11_HAS_FIBERS 1
+#	else
+#		define MIN11_HAS_FIBERS 0
+#	endif
+#endif
+
+/**
+ * MIN11_HAS_PARKING_LOT
+ *
+ * Set to 1 to build min11::mutex and min11::condition_variable on a global
+ * table of wait queues keyed by address (a "parking lot"). A mutex is then
+ * a single byte and a condition variable a one-byte waiter hint plus a
+ * pointer to its fiber waiters; neither owns an OS object. Only
+ * implemented by the pthreads backend.
+ */
+#if !defined(MIN11_HAS_PARKING_LOT)
+#	define MIN11_HAS_PARKING_LOT 0
+#endif
+
+/**
+ * MIN11_THREAD_LOCAL
+ *
+ * Storage class for a POD variable with one instance per thread. Min11
+ * will use `__thread', `__declspec(thread)' or `thread_local' when the
+ * compiler provides one; define MIN11_THREAD_LOCAL to override, or define
+ * MIN11_HAS_COMPILER_TLS to 0 to fall back to the platform's TLS API.
+ */
+#if !defined(MIN11_HAS_COMPILER_TLS)
+#	if defined(MIN11_THREAD_LOCAL)
+#		define MIN11_HAS_COMPILER_TLS 1
+#	elif defined(_MSC_VER)
+#		define MIN11_THREAD_LOCAL __declspec(thread)
+#		define MIN11_HAS_COMPILER_TLS 1
+#	elif defined(__GNUC__) || defined(__clang__)
+#		define MIN11_THREAD_LOCAL __thread
+#		define MIN11_HAS_COMPILER_TLS 1
+#	elif __cplusplus >= 201103L
+#		define MIN11_THREAD_LOCAL thread_local
+#		define MIN11_HAS_COMPILER_TLS 1
+#	else
+#		define MIN11_HAS_COMPILER_TLS 0
+#	endif
+#endif
+
 #endif // MIN11__CONFIG_H
@@ -0,0 +1,333 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__EPOCH_DOMAIN_H
+#define MIN11__EPOCH_DOMAIN_H
+
+#include "atomic.h"
+#include "thread_specific_ptr.h"
+
+#include <stddef.h> // size_t
+
+namespace min11
+{
+	namespace detail
+	{
+		struct retired_object
+		{
+			void* object;
+			void (*deleter)(void*);
+		};
+
+		/**
+		 * Objects retired by one thread during one epoch
+		 */
+		class retired_bag
+		{
+		public:
+			retired_bag()
+				: objects(0)
+				, count(0)
+				, capacity(0)
+				, epoch(0)
+			{
+			}
+
+			~retired_bag()
+			{
+				free_all();
+				delete[] objects;
+			}
+
+			void add(void* object, void (*deleter)(void*))
+			{
+				if (count == capacity)
+				{
+					capacity = capacity ? capacity * 2 : 32;
+					retired_object* grown = new retired_object[capacity];
+					for (size_t ii = 0; ii < count; ++ii)
+						grown[ii] = objects[ii];
+					delete[] objects;
+					objects = grown;
+				}
+
+				objects[count].object = object;
+				objects[count].deleter = deleter;
+				++count;
+			}
+
+			void free_all()
+			{
+				// deleters may retire more objects into other bags,
+				// never this one: it belongs to a past epoch
+				for (size_t ii = 0; ii < count; ++ii)
+					objects[ii].deleter(objects[ii].object);
+				count = 0;
+			}
+
+			size_t size() const
+			{
+				return count;
+			}
+
+			retired_object* objects;
+			size_t count;
+			size_t capacity;
+			long epoch;
+		};
+
+		/**
+		 * Per-thread participation in an epoch_domain. Records are never
+		 * freed before their domain; a thread's record returns to the
+		 * domain at thread exit, along with anything still retired in it,
+		 * for the next new thread to adopt.
+		 */
+		struct epoch_record
+		{
+			epoch_record()
+				: state(0)
+				, owned(1)
+				, nesting(0)
+				, retired_since_advance(0)
+				, next(0)
+			{
+			}
+
+			// (epoch << 1) | 1 while inside a critical section, else 0
+			volatile long state;
+			volatile long owned;
+			unsigned nesting;
+			size_t retired_since_advance;
+			retired_bag bags[3];
+			epoch_record* next;
+		};
+	}
+
+	/**
+	 * Epoch-based reclamation (Fraser) for lock-free data structures.
+	 *
+	 * Readers bracket every access to shared nodes with enter()/leave()
+	 * (or an epoch_domain::guard), which announces the global epoch in
+	 * the thread's own record: no shared counter is written per access.
+	 * A node unlinked from the structure is handed to retire() rather
+	 * than freed. The global epoch advances once every thread inside a
+	 * critical section has observed it, and nodes retired two epochs
+	 * ago are then unreachable and freed, in batches, by the thread
+	 * that retired them.
+	 *
+	 * A thread that stays inside a critical section holds back all
+	 * reclamation in the domain.
+	 */
+	class epoch_domain
+	{
+	public:
+		/**
+		 * Scoped critical section
+		 */
+		class guard
+		{
+		public:
+			explicit guard(epoch_domain& domain)
+				: domain(domain)
+			{
+				domain.enter();
+			}
+
+			~guard()
+			{
+				domain.leave();
+			}
+
+		private:
+			guard(const guard&); // = delete;
+			guard& operator=(const guard&); // = delete;
+
+			epoch_domain& domain;
+		};
+
+		// try to advance the epoch after every `batch' retirements by a
+		// thread
+		explicit epoch_domain(size_t batch = 64)
+			: epoch(0)
+			, records(0)
+			, batch(batch ? batch : 1)
+			, local(&epoch_domain::release_record)
+		{
+		}
+
+		// frees every retired object. No thread may still be using
+		// the domain.
+		~epoch_domain()
+		{
+			local.release();
+
+			detail::epoch_record* record = records;
+			while (record)
+			{
+				detail::epoch_record* next = record->next;
+				delete record;
+				record = next;
+			}
+		}
+
+		void enter()
+		{
+			detail::epoch_record* record = current();
+			if (record->nesting++)
+				return;
+
+			// sequentially consistent: the announcement is visible
+			// before any shared node is read
+			detail::atomic_store(&record->state, (detail::atomic_load(&epoch) << 1) | 1);
+		}
+
+		void leave()
+		{
+			detail::epoch_record* record = current();
+			if (--record->nesting)
+				return;
+
+			detail::atomic_store(&record->state, 0);
+		}
+
+		// free `object' with `deleter' once no thread can hold a
+		// reference to it
+		void retire(void* object, void (*deleter)(void*))
+		{
+			detail::epoch_record* record = current();
+			const long e = detail::atomic_load(&epoch);
+
+			// the bag for this epoch last held objects from epoch e-3 or
+			// earlier, which are now safe
+			detail::retired_bag& bag = record->bags[e % 3];
+			if (bag.epoch != e)
+			{
+				bag.free_all();
+				bag.epoch = e;
+			}
+			bag.add(object, deleter);
+
+			if (++record->retired_since_advance >= batch)
+			{
+				record->retired_since_advance = 0;
+				reclaim();
+			}
+		}
+
+		// retire an object allocated with new
+		template<typename T>
+		void retire(T* object)
+		{
+			retire(object, &delete_object<T>);
+		}
+
+		// try to advance the epoch, then free what the calling thread
+		// retired at least two epochs ago
+		void reclaim()
+		{
+			try_advance();
+
+			detail::epoch_record* record = current();
+			const long e = detail::atomic_load(&epoch);
+			for (int ii = 0; ii < 3; ++ii)
+			{
+				detail::retired_bag& bag = record->bags[ii];
+				if (bag.size() && e - bag.epoch >= 2)
+					bag.free_all();
+			}
+		}
+
+	private:
+		epoch_domain(const epoch_domain&); // = delete;
+		epoch_domain& operator=(const epoch_domain&); // = delete;
+
+		template<typename T>
+		static void delete_object(void* object)
+		{
+			delete static_cast<T*>(object);
+		}
+
+		static void release_record(detail::epoch_record* record)
+		{
+			record->nesting = 0;
+			detail::atomic_store(&record->state, 0);
+			detail::atomic_store(&record->owned, 0);
+		}
+
+		detail::epoch_record* current()
+		{
+			detail::epoch_record* record = local.get();
+			if (!record)
+			{
+				record = acquire_record();
+				local.reset(record);
+			}
+			return record;
+		}
+
+		// adopt a record released by an exited thread, or add one
+		detail::epoch_record* acquire_record()
+		{
+			for (detail::epoch_record* record = detail::atomic_load(&records); record; record = record->next)
+			{
+				if (!detail::atomic_load(&record->owned) && 0 == detail::atomic_compare_exchange(&record->owned, 0, 1))
+					return record;
+			}
+
+			detail::epoch_record* record = new detail::epoch_record;
+			detail::epoch_record* head = detail::atomic_load(&records);
+			for (;;)
+			{
+				record->next = head;
+				detail::epoch_record* previous = detail::atomic_compare_exchange(&records, head, record);
+				if (previous == head)
+					return record;
+				head = previous;
+			}
+		}
+
+		// advance the global epoch if every active thread has seen it
+		bool try_advance()
+		{
+			const long e = detail::atomic_load(&epoch);
+			for (detail::epoch_record* record = detail::atomic_load(&records); record; record = record->next)
+			{
+				const long state = detail::atomic_load(&record->state);
+				if ((state & 1) && (state >> 1) != e)
+					return false;
+			}
+
+			return e == detail::atomic_compare_exchange(&epoch, e, e + 1);
+		}
+
+		volatile long epoch;
+		detail::epoch_record* volatile records;
+		const size_t batch;
+		thread_specific_ptr<detail::epoch_record> local;
+	};
+}
+
+#endif // MIN11__EPOCH_DOMAIN_H
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__EXECUTOR_H
+#define MIN11__EXECUTOR_H
+
+#include "config.h"
+#include "stop_token.h"
+
+#if MIN11_HAS_RVALREFS
+#	include <type_traits> // std::decay
+#	include <utility> // std::move, std::forward
+#endif
+
+/**
+ * Executors
+ *
+ * An executor is any type providing
+ *   void submit(min11::detail::task* t);
+ * which takes ownership of `t' and arranges for t->run() to be called
+ * exactly once, on a thread of the executor's choosing. Arbitrary
+ * function objects are handed to an executor with min11::post(ex, f).
+ */
+namespace min11
+{
+	namespace detail
+	{
+		/**
+		 * Intrusive unit of work handed to an executor. run() consumes
+		 * the task; heap allocated tasks delete themselves before
+		 * returning.
+		 */
+		class task
+		{
+		public:
+			task()
+				: next(0)
+			{
+			}
+
+			virtual ~task()
+			{
+			}
+
+			virtual void run() = 0;
+
+			// link used by the executor's queue while the task is pending
+			task* next;
+
+		private:
+			task(const task&); // = delete;
+			task& operator=(const task&); // = delete;
+		};
+
+		/**
+		 * Task invoking a copy of a nullary function object
+		 */
+		template<typename Func>
+		class function_task : public task
+		{
+		public:
+			explicit function_task(const Func& f)
+				: f(f)
+			{
+			}
+
+#if MIN11_HAS_RVALREFS
+			explicit function_task(Func&& f)
+				: f(std::move(f))
+			{
+			}
+#endif
+
+			virtual void run()
+			{
+				// release the task before invoking so a throwing
+				// function object does not leak it
+#if MIN11_HAS_RVALREFS
+				Func local(std::move(f));
+#else
+				Func local(f);
+#endif
+				delete this;
+				local();
+			}
+
+		private:
+			Func f;
+		};
+
+		/**
+		 * Task invoking a function object unless stop has been requested
+		 * by the time it runs
+		 */
+		template<typename Func>
+		class cancellable_task : public task
+		{
+		public:
+			cancellable_task(const Func& f, const stop_token& token)
+				: f(f)
+				, token(token)
+			{
+			}
+
+			virtual void run()
+			{
+				if (token.stop_requested())
+				{
+					delete this;
+					return;
+				}
+
+				Func local(f);
+				delete this;
+				local();
+			}
+
+		private:
+			Func f;
+			stop_token token;
+		};
+
+		// submit through an executor whose type has been erased
+		template<typename Executor>
+		void submit_to(void* ex, task* t)
+		{
+			static_cast<Executor*>(ex)->submit(t);
+		}
+
+#if MIN11_HAS_RVALREFS
+		template<typename Func>
+		task* make_task(Func&& f)
+		{
+			return new function_task<typename std::decay<Func>::type>(std::forward<Func>(f));
+		}
+#else
+		template<typename Func>
+		task* make_task(const Func& f)
+		{
+			return new function_task<Func>(f);
+		}
+#endif
+	}
+
+	/**
+	 * Submit the function object `f' to the executor `ex'
+	 */
+#if MIN11_HAS_RVALREFS
+	template<typename Executor, typename Func>
+	void post(Executor& ex, Func&& f)
+	{
+		ex.submit(detail::make_task(std::forward<Func>(f)));
+	}
+#else
+	template<typename Executor, typename Func>
+	void post(Executor& ex, const Func& f)
+	{
+		ex.submit(detail::make_task(f));
+	}
+#endif
+
+	/**
+	 * Submit the function object `f' to the executor `ex'. `f' is dropped
+	 * without being called if stop is requested on `token' before the
+	 * executor runs it.
+	 */
+	template<typename Executor, typename Func>
+	void post(Executor& ex, const Func& f, const stop_token& token)
+	{
+		ex.submit(new detail::cancellable_task<Func>(f, token));
+	}
+
+	/**
+	 * Executor running each task immediately on the submitting thread
+	 */
+	class inline_executor
+	{
+	public:
+		void submit(detail::task* t)
+		{
+			t->run();
+		}
+	};
+}
+
+#endif // MIN11__EXECUTOR_H
@@ -0,0 +1,376 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__FIBER_H
+#define MIN11__FIBER_H
+
+#include "config.h"
+
+#if MIN11_HAS_FIBERS
+
+#include "condition_variable.h"
+#include "executor.h"
+#include "future.h"
+#include "mutex.h"
+#include "thread.h"
+
+#include <exception> // std::terminate
+#include <stddef.h> // size_t
+
+namespace min11
+{
+	class fiber_scheduler;
+
+	namespace detail
+	{
+		/**
+		 * Saved execution context of a fiber or of a thread switching
+		 * between fibers
+		 */
+		struct fiber_context;
+
+		// context running entry(arg) on a new stack of `stack_size'
+		// bytes. `entry' must never return. Returns null on failure.
+		fiber_context* create_fiber_context(void (*entry)(void*), void* arg, size_t stack_size);
+		void destroy_fiber_context(fiber_context* context);
+
+		// context of the calling thread, which must be released by the
+		// same thread once it has stopped switching to fibers
+		fiber_context* convert_thread_to_fiber();
+		void release_thread_fiber(fiber_context* context);
+
+		// save the caller into `from' and resume `to'
+		void switch_fiber_context(fiber_context* from, fiber_context* to);
+
+		/**
+		 * Fiber running a single task. Registered as the waiter of a
+		 * future the fiber is suspended on.
+		 */
+		class fiber_record : public future_waiter
+		{
+		public:
+			explicit fiber_record(fiber_scheduler* owner, task* body)
+				: context(0)
+				, body(body)
+				, owner(owner)
+				, ready_next(0)
+				, add(0)
+				, object(0)
+				, finished(false)
+			{
+			}
+
+			virtual ~fiber_record()
+			{
+			}
+
+			virtual void notify();
+
+			fiber_context* context;
+			task* body;
+			fiber_scheduler* owner;
+			fiber_record* ready_next;
+
+			// set by a suspending fiber, consumed by the worker that
+			// switched away from it
+			bool (*add)(void*, future_waiter*);
+			void* object;
+			bool finished;
+		};
+
+		/**
+		 * Wait hook installed on every worker thread of a
+		 * fiber_scheduler
+		 */
+		class fiber_worker : public wait_hook
+		{
+		public:
+			fiber_worker()
+				: main(0)
+				, current(0)
+			{
+			}
+
+			virtual bool suspends_fiber() const
+			{
+				// worker code between fibers blocks as usual
+				return current != 0;
+			}
+
+			virtual void suspend(bool (*add)(void*, future_waiter*), void* object)
+			{
+				// the fiber may be resumed by another worker: nothing of
+				// `this' is used after switching back
+				fiber_record* f = current;
+				f->add = add;
+				f->object = object;
+				switch_fiber_context(f->context, main);
+			}
+
+			fiber_context* main;
+			fiber_record* current;
+		};
+	}
+
+	/**
+	 * M:N scheduler running tasks as fibers over a fixed set of worker
+	 * threads. A fiber waiting on a future (future::wait/get with the
+	 * blocking or hybrid policy, shared_future, ...) is suspended and
+	 * its worker runs other fibers until the value is set; the fiber
+	 * may then resume on any worker. A fiber is likewise suspended by
+	 * condition_variable::wait, and rescheduled until a contended
+	 * min11::mutex or pi_mutex is free; condition_variable::wait_for
+	 * still blocks the worker thread. A lock held while a fiber suspends
+	 * may be released from another worker, which the platform's mutex
+	 * need not allow; with more than one worker, release locks before
+	 * waiting on a future or yielding. Satisfies the executor
+	 * requirements (see executor.h): each submitted task runs on a
+	 * fiber of its own.
+	 */
+	class fiber_scheduler
+	{
+		friend class detail::fiber_record;
+	public:
+		// start `threads' workers (0 starts one per hardware thread);
+		// each fiber gets a stack of `stack_size' bytes
+		explicit fiber_scheduler(unsigned threads = 0, size_t stack_size = 64 * 1024)
+			: head(0)
+			, tail(0)
+			, idle(0)
+			, live(0)
+			, stopping(false)
+			, stack_size(stack_size)
+		{
+			nworkers = threads ? threads : detail::hardware_concurrency();
+			if (nworkers == 0)
+				nworkers = 1;
+
+			workers = new detail::thread_internal*[nworkers];
+			for (unsigned ii = 0; ii < nworkers; ++ii)
+			{
+				workers[ii] = detail::create_thread(&fiber_scheduler::worker_main, this, 0);
+				if (!workers[ii])
+				{
+					nworkers = ii;
+					stop();
+					detail::throw_thread_error("failed to create fiber scheduler worker");
+				}
+			}
+		}
+
+		// wait for every fiber to finish, then join the workers
+		~fiber_scheduler()
+		{
+			stop();
+		}
+
+		void submit(detail::task* t)
+		{
+			detail::fiber_record* f = new detail::fiber_record(this, t);
+			f->context = detail::create_fiber_context(&fiber_scheduler::fiber_main, f, stack_size);
+			if (!f->context)
+			{
+				delete f;
+				delete t;
+				detail::throw_thread_error("failed to create fiber");
+			}
+
+			{
+				unique_lock<mutex> lock(mtx);
+				++live;
+			}
+			make_ready(f);
+		}
+
+#if MIN11_HAS_RVALREFS
+		template<typename Func>
+		void post(Func&& f)
+		{
+			submit(detail::make_task(std::forward<Func>(f)));
+		}
+#else
+		template<typename Func>
+		void post(const Func& f)
+		{
+			submit(detail::make_task(f));
+		}
+#endif
+
+		unsigned size() const
+		{
+			return nworkers;
+		}
+
+	private:
+		fiber_scheduler(const fiber_scheduler&); // = delete;
+		fiber_scheduler& operator=(const fiber_scheduler&); // = delete;
+
+		void make_ready(detail::fiber_record* f)
+		{
+			unique_lock<mutex> lock(mtx);
+			f->ready_next = 0;
+			if (tail)
+				tail->ready_next = f;
+			else
+				head = f;
+			tail = f;
+			if (idle)
+				cond.notify_one();
+		}
+
+		void stop()
+		{
+			{
+				unique_lock<mutex> lock(mtx);
+				stopping = true;
+				cond.notify_all();
+			}
+
+			for (unsigned ii = 0; ii < nworkers; ++ii)
+				detail::join_thread(workers[ii]);
+			delete[] workers;
+		}
+
+		static void fiber_main(void* arg)
+		{
+			detail::fiber_record* f = static_cast<detail::fiber_record*>(arg);
+#if MIN11_HAS_EXCEPTIONS
+			try
+			{
+				f->body->run();
+			}
+			catch (...)
+			{
+				// as with a thread, an escaping exception is fatal
+				std::terminate();
+			}
+#else
+			f->body->run();
+#endif
+			f->body = 0;
+			f->finished = true;
+
+			// the fiber may have moved since it started; switch back to
+			// whichever worker is running it now
+			detail::fiber_worker* worker = static_cast<detail::fiber_worker*>(detail::current_wait_hook());
+			detail::switch_fiber_context(f->context, worker->main);
+		}
+
+		static void worker_main(void* arg)
+		{
+			fiber_scheduler* s = static_cast<fiber_scheduler*>(arg);
+
+			detail::fiber_worker worker;
+			worker.main = detail::convert_thread_to_fiber();
+			detail::set_current_wait_hook(&worker);
+
+			for (;;)
+			{
+				detail::fiber_record* f;
+				{
+					unique_lock<mutex> lock(s->mtx);
+					while (!s->head && !(s->stopping && !s->live))
+					{
+						++s->idle;
+						s->cond.wait(lock);
+						--s->idle;
+					}
+
+					f = s->head;
+					if (!f)
+						break;
+
+					s->head = f->ready_next;
+					if (!s->head)
+						s->tail = 0;
+				}
+
+				worker.current = f;
+				detail::switch_fiber_context(worker.main, f->context);
+				worker.current = 0;
+
+				if (f->finished)
+				{
+					detail::destroy_fiber_context(f->context);
+					delete f;
+
+					unique_lock<mutex> lock(s->mtx);
+					if (0 == --s->live && s->stopping)
+						s->cond.notify_all();
+				}
+				else if (f->add)
+				{
+					// the fiber's context is saved: it is now safe for
+					// the awaited state to resume it from another thread
+					bool (*add)(void*, detail::future_waiter*) = f->add;
+					f->add = 0;
+					if (!add(f->object, f))
+						s->make_ready(f);
+				}
+				else
+				{
+					s->make_ready(f);
+				}
+			}
+
+			detail::set_current_wait_hook(0);
+			detail::release_thread_fiber(worker.main);
+		}
+
+		mutex mtx;
+		condition_variable cond;
+		detail::fiber_record* head;
+		detail::fiber_record* tail;
+		unsigned idle;
+		unsigned live;
+		bool stopping;
+		size_t stack_size;
+		unsigned nworkers;
+		detail::thread_internal** workers;
+	};
+
+	inline void detail::fiber_record::notify()
+	{
+		owner->make_ready(this);
+	}
+
+	namespace this_fiber
+	{
+		// let other fibers on this worker run; outside a fiber, yields
+		// the thread
+		inline void yield()
+		{
+			if (detail::wait_hook* hook = detail::current_wait_hook())
+				hook->suspend(0, 0);
+			else
+				detail::yield_thread();
+		}
+	}
+}
+
+#endif // MIN11_HAS_FIBERS
+
+#endif // MIN11__FIBER_H
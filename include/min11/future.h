@@ -28,60 +28,99 @@
 #define MIN11__FUTURE_H
 
 #include "config.h"
-#include "atomic_counter.h"
+#include "atomic.h"
 #include "condition_variable.h"
 #include "mutex.h"
+#include "stop_token.h"
 
 #if MIN11_HAS_EXCEPTIONS
 #	include <stdexcept>
 #endif
 
 #if MIN11_HAS_RVALREFS
-#	include <utility> // std::move
+#	include <type_traits> // std::decay
+#	include <utility> // std::move, std::forward
+#endif
+
+#if MIN11_HAS_EXCEPTION_PTR
+#	include <exception> // std::exception_ptr
 #endif
 
 #if MIN11_HAS_FUTURE_CONTINUATIONS
 #	include <functional> // std::function
+#	include "executor.h"
+#endif
+
+#if MIN11_HAS_COROUTINES
+#	include <coroutine>
 #endif
 
 namespace min11
 {	
-	template<typename T> class future;
-	template<typename T> class shared_future;
-	template<typename T> class promise;
-	namespace detail { template<typename T> class future_state; }
+	/**
+	 * Synchronization policies for future, shared_future and promise,
+	 * selecting how the shared state is guarded and how a consumer
+	 * waits for its value:
+	 *
+	 * blocking: (default) a lock word guards the state; a waiter that
+	 *   finds it not ready blocks on a lazily created mutex and
+	 *   condition variable (or, on a fiber, suspends the fiber)
+	 * spin: as blocking, but waiters busy-wait and never sleep
+	 * hybrid: waiters spin for `spin_count' iterations, then block
+	 * single_threaded: no atomics or locks. Every future and promise
+	 *   sharing a state must be used from one thread, and waiting on a
+	 *   state that is not ready throws future_error (it would never
+	 *   become ready); use continuations or co_await instead.
+	 */
+	namespace future_policy
+	{
+		struct blocking {};
+		struct spin {};
+		struct hybrid { enum { spin_count = 4000 }; };
+		struct single_threaded {};
+	}
+
+	template<typename T, typename Policy = future_policy::blocking> class future;
+	template<typename T, typename Policy = future_policy::blocking> class shared_future;
+	template<typename T, typename Policy = future_policy::blocking> class promise;
+	namespace detail { template<typename T, typename Policy> class future_state; }
+#if MIN11_HAS_COROUTINES
+	namespace detail { template<typename Future> class future_awaiter; }
+#endif
 #if !MIN11_HAS_RVALREFS
-	namespace detail { template<typename T> class movable_future; }
+	namespace detail { template<typename T, typename Policy = future_policy::blocking> class movable_future; }
 
 	/**
 	 * Create a movable reference to a future
 	 */
-	template<typename T>
-	detail::movable_future<T> move(future<T>& f)
+	template<typename T, typename Policy>
+	detail::movable_future<T, Policy> move(future<T, Policy>& f)
 	{
-		return detail::movable_future<T>::from_future(f);
+		return detail::movable_future<T, Policy>::from_future(f);
 	}
 
 	namespace detail
 	{
 		/**
 		 * helper class to represent a "movable" future. The expression
-		 * detail::movable_future<T>(ftr) should be roughly equivalent to an
+		 * detail::movable_future<T, Policy>(ftr) should be roughly equivalent to an
 		 * rvalue reference to `ftr': similar to the expression std::move(ftr)
 		 */
-		template<typename T>
+		template<typename T, typename Policy>
 		class movable_future
 		{
-			friend class future<T>;
-			friend class shared_future<T>;
-			friend class promise<T>;
+			friend class future<T, Policy>;
+			friend class shared_future<T, Policy>;
+			friend class promise<T, Policy>;
 
 		public:
+			// copying transfers the reference, as std::auto_ptr does: a
+			// movable_future is only a temporary on its way into a future
+			// or shared_future, so the reference is never counted twice
 			movable_future(const movable_future& rhs)
 				: state(rhs.state)
 			{
-				if (state)
-					state->add_ref();
+				rhs.state = 0;
 			}
 
 			~movable_future()
@@ -90,32 +129,32 @@ namespace min11
 					state->dec_ref();
 			}
 
-			static movable_future<T> from_future(future<T>& f)
+			static movable_future<T, Policy> from_future(future<T, Policy>& f)
 			{
-				return movable_future<T>(f);
+				return movable_future<T, Policy>(f);
 			}
 
-			shared_future<T> share()
+			shared_future<T, Policy> share()
 			{
-				return shared_future<T>(*this);
+				return shared_future<T, Policy>(*this);
 			}
 
 		private:
 			movable_future& operator=(const movable_future&); // = delete;
 
-			explicit movable_future(future<T>& f)
+			explicit movable_future(future<T, Policy>& f)
 				: state(f.state)
 			{
 				f.state = 0;
 			}
 			
-			explicit movable_future(detail::future_state<T>* state)
+			// adopts the reference added by future_state::attach_future
+			explicit movable_future(detail::future_state<T, Policy>* state)
 				: state(state)
 			{
-				state->add_ref();
 			}
 			
-			mutable detail::future_state<T>* state;
+			mutable detail::future_state<T, Policy>* state;
 		};
 	}
 #else
@@ -146,18 +185,73 @@ namespace min11
 			MIN11_THROW_EXCEPTION(message);
 #endif
 		}
+
+		/**
+		 * Exception stored in a state in place of a value, rethrown by
+		 * every get()
+		 */
+		class future_exception
+		{
+		public:
+			virtual ~future_exception()
+			{
+			}
+
+			virtual void rethrow() const = 0;
+		};
+
+		template<typename E>
+		class typed_future_exception : public future_exception
+		{
+		public:
+			explicit typed_future_exception(const E& e)
+				: e(e)
+			{
+			}
+
+			virtual void rethrow() const
+			{
+#if MIN11_HAS_EXCEPTIONS
+				throw e;
+#else
+				MIN11_THROW_EXCEPTION("future holds an exception");
+#endif
+			}
+
+		private:
+			E e;
+		};
+
+#if MIN11_HAS_EXCEPTION_PTR
+		class future_exception_ptr : public future_exception
+		{
+		public:
+			explicit future_exception_ptr(const std::exception_ptr& p)
+				: p(p)
+			{
+			}
+
+			virtual void rethrow() const
+			{
+				std::rethrow_exception(p);
+			}
+
+		private:
+			std::exception_ptr p;
+		};
+#endif
 	}
 
 	/**
 	 * Minimal emulation for std::future
 	 */
-	template<typename T>
+	template<typename T, typename Policy>
 	class future
 	{
-		friend class promise<T>;
-		friend class shared_future<T>;
+		friend class promise<T, Policy>;
+		friend class shared_future<T, Policy>;
 #if !MIN11_HAS_RVALREFS
-		friend class detail::movable_future<T>;
+		friend class detail::movable_future<T, Policy>;
 #endif
 	public:
 		future()
@@ -166,14 +260,14 @@ namespace min11
 		}
 
 #if MIN11_HAS_RVALREFS
-		future(future<T>&& rhs)
+		future(future<T, Policy>&& rhs)
 			: state(rhs.state)
 		{
 			rhs.state = 0;
 		}
 
 #else
-		future(const detail::movable_future<T>& rhs)
+		future(const detail::movable_future<T, Policy>& rhs)
 			: state(rhs.state)
 		{
 			rhs.state = 0;
@@ -187,14 +281,14 @@ namespace min11
 		}
 		
 #if MIN11_HAS_RVALREFS
-		future& operator=(future<T>&& rhs)
+		future& operator=(future<T, Policy>&& rhs)
 		{
 			state = rhs.state;
 			rhs.state = 0;
 			return *this;
 		}
 #else
-		future& operator=(const detail::movable_future<T>& rhs)
+		future& operator=(const detail::movable_future<T, Policy>& rhs)
 		{
 			state = rhs.state;
 			rhs.state = 0;
@@ -226,10 +320,20 @@ namespace min11
 			state->wait();
 		}
 		
-		shared_future<T> share()
+		shared_future<T, Policy> share()
+		{
+			return shared_future<T, Policy>(move(*this));
+		}
+
+#if MIN11_HAS_COROUTINES
+		detail::future_awaiter<future<T, Policy> > operator co_await()
 		{
-			return shared_future<T>(move(*this));
+			if (!valid())
+				detail::throw_future_error("future has no state object, likely shared");
+
+			return detail::future_awaiter<future<T, Policy> >(*this, state);
 		}
+#endif
 
 #if MIN11_HAS_FUTURE_CONTINUATIONS
 		template<typename Func>
@@ -248,26 +352,39 @@ namespace min11
 			state->set_continuation(f);
 #endif
 		}
+
+		/**
+		 * Run `f' on the executor `ex' once the state is set, instead
+		 * of on the thread setting the value. `ex' must outlive the
+		 * state.
+		 */
+		template<typename Executor, typename Func>
+		void set_continuation(Executor& ex, const Func& f)
+		{
+			if (!valid())
+				detail::throw_future_error("future has no state object, likely shared");
+
+			state->set_continuation(ex, f);
+		}
 #endif
 
 	private:
 		explicit future(const future&); // = delete;
 		future& operator=(const future&); // = delete;
 
-		future(detail::future_state<T>* s)
+		// adopts the reference added by future_state::attach_future
+		future(detail::future_state<T, Policy>* s)
 			: state(s)
 		{
-			if (s)
-				s->add_ref();
 		}
 	
-		detail::future_state<T>* state;
+		detail::future_state<T, Policy>* state;
 	};
 	
 	/**
 	 * Minimal emulation for std::shared_future
 	 */
-	template<typename T>
+	template<typename T, typename Policy>
 	class shared_future
 	{
 	public:
@@ -277,7 +394,7 @@ namespace min11
 		}
 
 #if MIN11_HAS_RVALREFS
-		shared_future(future<T>&& rhs)
+		shared_future(future<T, Policy>&& rhs)
 			: state(0)
 		{
 #if MIN11_HAS_FUTURE_CONTINUATIONS
@@ -288,13 +405,13 @@ namespace min11
 			rhs.state = 0;
 		}
 
-		shared_future(shared_future<T>&& rhs)
+		shared_future(shared_future<T, Policy>&& rhs)
 			: state(rhs.state)
 		{
 			rhs.state = 0;
 		}
 #else
-		shared_future(const detail::movable_future<T>& rhs)
+		shared_future(const detail::movable_future<T, Policy>& rhs)
 			: state(0)
 		{
 #if MIN11_HAS_FUTURE_CONTINUATIONS
@@ -306,7 +423,7 @@ namespace min11
 		}
 #endif
 		
-		shared_future(const shared_future<T>& other)
+		shared_future(const shared_future<T, Policy>& other)
 			: state(other.state)
 		{
 			if (state)
@@ -330,7 +447,7 @@ namespace min11
 		}
 		
 #if MIN11_HAS_RVALREFS
-		shared_future& operator=(future<T>&& rhs)
+		shared_future& operator=(future<T, Policy>&& rhs)
 		{
 			if (state)
 				state->dec_ref();
@@ -345,7 +462,7 @@ namespace min11
 			return *this;
 		}
 
-		shared_future& operator=(shared_future<T>&& rhs)
+		shared_future& operator=(shared_future<T, Policy>&& rhs)
 		{
 			if (state)
 				state->dec_ref();
@@ -355,7 +472,7 @@ namespace min11
 			return *this;
 		}
 #else
-		shared_future& operator=(const detail::movable_future<T>& rhs)
+		shared_future& operator=(const detail::movable_future<T, Policy>& rhs)
 		{
 			if (state)
 				state->dec_ref();
@@ -392,25 +509,35 @@ namespace min11
 			return state->get_value(true);
 		}
 
+#if MIN11_HAS_COROUTINES
+		detail::future_awaiter<const shared_future<T, Policy> > operator co_await() const
+		{
+			if (!valid())
+				detail::throw_future_error("future has no state object");
+
+			return detail::future_awaiter<const shared_future<T, Policy> >(*this, state);
+		}
+#endif
+
 	private:
-		detail::future_state<T>* state;
+		detail::future_state<T, Policy>* state;
 	};
 	
 	/**
 	 * Minimal emulation of std::promise
 	 */
-	template<typename T>
+	template<typename T, typename Policy>
 	class promise
 	{
 	public:
 		promise()
-			: state(new detail::future_state<T>)
+			: state(new detail::future_state<T, Policy>)
 		{
 		}
 		
 		~promise()
 		{
-			state->dec_ref();
+			state->release_promise();
 		}
 		
 #if MIN11_HAS_RVALREFS
@@ -424,300 +551,1195 @@ namespace min11
 			state->set_value(value);
 		}
 
+		/**
+		 * Store a copy of `e' in place of the value. Every get() on a
+		 * future sharing the state throws a copy of it.
+		 */
+		template<typename E>
+		void set_exception(const E& e)
+		{
+			state->set_exception(new detail::typed_future_exception<E>(e));
+		}
+
+#if MIN11_HAS_EXCEPTION_PTR
+		void set_exception(std::exception_ptr p)
+		{
+			state->set_exception(new detail::future_exception_ptr(p));
+		}
+#endif
 		
 #if MIN11_HAS_RVALREFS
-		future<T> get_future()
+		future<T, Policy> get_future()
 		{
-			return future<T>(state);
+			state->attach_future();
+			return future<T, Policy>(state);
 		}
 #else
-		detail::movable_future<T> get_future()
+		detail::movable_future<T, Policy> get_future()
 		{
-			return detail::movable_future<T>(state);
+			state->attach_future();
+			return detail::movable_future<T, Policy>(state);
 		}
 #endif
 
+		// stop token requested once every future obtained from this
+		// promise, and every shared_future copied from those, has been
+		// released: nobody is left to observe the value
+		stop_token get_stop_token()
+		{
+			return stop_token(state->consumers_stop_state());
+		}
+
 	private:
 		promise(const promise&); // = delete;
 		promise& operator=(const promise&); // = delete;
 
-		detail::future_state<T>* state;
+		detail::future_state<T, Policy>* state;
 	};
 	
 	namespace detail
 	{
-		template<typename T>
-		class future_state
+		/**
+		 * Waiter notified, outside the state's lock, once a state becomes
+		 * ready. Registered with future_state_base::add_waiter.
+		 */
+		class future_waiter
 		{
-			friend class future<T>;
 		public:
-			future_state()
-				: refcnt(1)
-				, retrieved(false)
-				, ready(false)
+			virtual void notify() = 0;
+
+			future_waiter* next;
+
+		protected:
+			~future_waiter()
 			{
 			}
+		};
 
-			void add_ref()
+		/**
+		 * Per-thread hook letting a user-space scheduler (see fiber.h)
+		 * suspend the calling fiber, rather than its thread, while a
+		 * future it waits on is not ready.
+		 */
+		class wait_hook
+		{
+		public:
+			// Suspend the caller. Once it can safely be resumed the hook
+			// calls add(object, w) to register a waiter resuming it; if
+			// that returns false the object is already ready and the
+			// caller is resumed at once. A null `add' just reschedules
+			// the caller.
+			virtual void suspend(bool (*add)(void*, future_waiter*), void* object) = 0;
+
+			// true if suspend() switches the caller out to a scheduler
+			// that runs something else meanwhile. Only such hooks also
+			// suspend waits on a mutex or condition_variable; the others
+			// would run unrelated work while the caller holds locks.
+			virtual bool suspends_fiber() const
 			{
-				refcnt.incr();
+				return false;
 			}
 
-			void dec_ref()
+		protected:
+			~wait_hook()
+			{
+			}
+		};
+
+		// hook installed for the calling thread, if any
+		wait_hook* current_wait_hook();
+		void set_current_wait_hook(wait_hook* hook);
+
+		/**
+		 * Lock word guarding a state's flags, waiter list and
+		 * continuation. Only held for a handful of loads and stores;
+		 * never while blocking or running user code.
+		 */
+		class state_lock
+		{
+		public:
+			state_lock()
+				: word(0)
+			{
+			}
+
+			void lock()
 			{
-				if (0 == refcnt.decr())
+				for (int spins = 0; atomic_exchange(&word, 1); ++spins)
 				{
-					delete this;
+					if (spins < 64)
+						cpu_relax();
+					else
+						yield_thread();
 				}
 			}
 
-#if MIN11_HAS_RVALREFS
-			void set_value(T&& value)
+			void unlock()
 			{
-				unique_lock<mutex> lock(mtx);
-				set_value_with_lock(std::move(value));
+				atomic_store(&word, 0);
 			}
-#endif
-			void set_value(const T& value)
+
+		private:
+			state_lock(const state_lock&); // = delete;
+			state_lock& operator=(const state_lock&); // = delete;
+
+			volatile long word;
+		};
+
+		/**
+		 * Fibers suspended in a condition_variable's wait, in arrival
+		 * order. Created by the variable's first fiber waiter.
+		 */
+		struct condition_fibers
+		{
+			condition_fibers()
+				: count(0)
+				, head(0)
+				, tail(0)
 			{
-				unique_lock<mutex> lock(mtx);
-				set_value_with_lock(value);
 			}
 
-			T& get_value(bool allow_multiple_gets)
+			state_lock guard;
+			volatile long count;
+			future_waiter* head;
+			future_waiter* tail;
+		};
+
+		// hook of the fiber running on the calling thread, if any
+		inline wait_hook* current_fiber_hook()
+		{
+			wait_hook* hook = current_wait_hook();
+			return (hook && hook->suspends_fiber()) ? hook : 0;
+		}
+
+		// Take `mtx' after a failed try_lock by rescheduling the calling
+		// fiber until the lock is free, so its worker keeps running other
+		// fibers (one of which may hold the lock). Returns false without
+		// locking if the caller is not a fiber.
+		template<typename M>
+		bool lock_as_fiber(M* mtx)
+		{
+			wait_hook* hook = current_fiber_hook();
+			if (!hook)
+				return false;
+
+			do
 			{
-				unique_lock<mutex> lock(mtx);
-				if (retrieved && !allow_multiple_gets)
-					detail::throw_future_error("future already retreived");
-					
-				while (!ready)
-					cond.wait(lock);
+				hook->suspend(0, 0);
 
-				if (retrieved && !allow_multiple_gets)
-					detail::throw_future_error("future already retreived");
+				// the fiber may have resumed on another worker
+				hook = current_wait_hook();
+			} while (!mtx->try_lock());
 
-				retrieved = true;
-				return value;
+			return true;
+		}
+
+		/**
+		 * Entry queued on a condition variable by a waiting fiber, on
+		 * that fiber's stack. The queue stays locked until the fiber has
+		 * switched out and add() has recorded the waiter resuming it, so
+		 * a notifier never resumes a fiber that is still running.
+		 */
+		class condition_fiber_wait : public future_waiter
+		{
+		public:
+			explicit condition_fiber_wait(condition_fibers* fibers)
+				: fibers(fibers)
+				, fiber(0)
+			{
 			}
-			
-			void wait()
+
+			virtual void notify()
 			{
-				unique_lock<mutex> lock(mtx);
-				while (!ready)
-					cond.wait(lock);
+				// resuming the fiber releases `this'
+				fiber->notify();
 			}
 
-			template<typename Func>
-#if MIN11_HAS_RVALREFS
-			void set_continuation(Func&& f)
-#else
-			void set_continuation(const Func& f)
-#endif
+			static bool add(void* object, future_waiter* w)
+			{
+				condition_fiber_wait* self = static_cast<condition_fiber_wait*>(object);
+				self->fiber = w;
+				self->fibers->guard.unlock();
+				return true;
+			}
+
+			condition_fibers* fibers;
+			future_waiter* fiber;
+		};
+
+		// Wait on the condition variable owning `fibers' by suspending the
+		// calling fiber. `mtx' is released once the fiber is queued and
+		// held again on return. Returns false without waiting if the
+		// caller is not a fiber.
+		template<typename M>
+		bool wait_as_fiber(condition_fibers* volatile* fibers, M* mtx)
+		{
+			wait_hook* hook = current_fiber_hook();
+			if (!hook)
+				return false;
+
+			condition_fibers* f = atomic_load(fibers);
+			if (!f)
 			{
-				unique_lock<mutex> lock(mtx);
+				condition_fibers* created = new condition_fibers;
+				f = atomic_compare_exchange(fibers, static_cast<condition_fibers*>(0), created);
+				if (f)
+					delete created;
+				else
+					f = created;
+			}
 
-				if (cont)
-					detail::throw_future_error("continuation state already set");
-				if (retrieved)
-					detail::throw_future_error("future already retrieved");
+			condition_fiber_wait wait(f);
+			f->guard.lock();
+			wait.next = 0;
+			if (f->tail)
+				f->tail->next = &wait;
+			else
+				f->head = &wait;
+			f->tail = &wait;
+			atomic_fetch_add(&f->count, 1);
+			mtx->unlock();
+
+			hook->suspend(&condition_fiber_wait::add, &wait);
+			mtx->lock();
+			return true;
+		}
+
+		// wake the longest waiting fiber, or every fiber if `all'.
+		// Returns false if no fiber was waiting.
+		inline bool notify_fibers(condition_fibers* volatile* fibers, bool all)
+		{
+			condition_fibers* f = atomic_load(fibers);
+			if (!f || 0 == atomic_load(&f->count))
+				return false;
 
-				if (ready)
+			f->guard.lock();
+			future_waiter* w = f->head;
+			if (w)
+			{
+				if (all)
 				{
-					retrieved = true;
-#if MIN_HAS_RVALREFS
-					f(std::move(value));
-#else
-					f(value);
-#endif
+					f->head = 0;
+					f->tail = 0;
+					atomic_store(&f->count, 0);
 				}
 				else
 				{
-#if MIN11_HAS_RVALREFS
-					cont = std::move(f);
-#else
-					cont = f;
-#endif
+					f->head = w->next;
+					if (!f->head)
+						f->tail = 0;
+					atomic_fetch_add(&f->count, -1);
 				}
 			}
+			f->guard.unlock();
 
-		private:
-			future_state(const future_state&); // = delete;
-			future_state& operator=(const future_state&); // = delete;
-			
-#if MIN11_HAS_RVALREFS
-			void set_value_with_lock(T&& v)
+			if (!w)
+				return false;
+
+			while (w)
 			{
-				if (ready)
-					detail::throw_future_error("future state already set");
+				// a notified fiber may run, and wait again, at once
+				future_waiter* next = all ? w->next : 0;
+				w->notify();
+				w = next;
+			}
 
-				value = std::move(v);
-				ready = true;
-				notify_with_lock();
+			return true;
+		}
+
+		/**
+		 * Lock standing in for state_lock under the single_threaded
+		 * policy
+		 */
+		class null_lock
+		{
+		public:
+			void lock()
+			{
 			}
-#endif
 
-			void set_value_with_lock(const T& v)
+			void unlock()
 			{
-				if (ready)
-					detail::throw_future_error("future state already set");
+			}
+		};
 
-				value = v;
-				ready = true;
-				notify_with_lock();
+		/**
+		 * Atomic operations and lock used by a state under `Policy'.
+		 * Every policy but single_threaded uses real atomics.
+		 */
+		template<typename Policy>
+		struct future_sync
+		{
+			typedef state_lock lock_type;
+
+			static long load(const volatile long* p)
+			{
+				return atomic_load(p);
 			}
 
-			void notify_with_lock()
+			static void store(volatile long* p, long value)
 			{
-#if MIN11_HAS_FUTURE_CONTINUATIONS
-#if MIN11_HAS_RVALREFS
-				if (cont)
-					cont(std::move(value));
-#else
-				if (cont)
-					cont(value);
-#endif
-#endif
-				cond.notify_all();
+				atomic_store(p, value);
 			}
 
-			detail::atomic_counter refcnt;
-			T value;
-			mutex mtx;
-			condition_variable cond;
-#if MIN11_HAS_FUTURE_CONTINUATIONS
-#if MIN11_HAS_RVALUES
-			std::function<void(T&&)> cont;
-#else
-			std::function<void(const T&)> cont;
-#endif
-#endif
-			bool retrieved;
-			volatile bool ready;
+			static long compare_exchange(volatile long* p, long expected, long desired)
+			{
+				return atomic_compare_exchange(p, expected, desired);
+			}
+
+			static long fetch_add(volatile long* p, long value)
+			{
+				return atomic_fetch_add(p, value);
+			}
 		};
 
 		template<>
-		class future_state<void>
+		struct future_sync<future_policy::single_threaded>
 		{
-			friend class future<void>;
-			friend class shared_future<void>;
-		public:
-			future_state()
-				: refcnt(1)
-				, retrieved(false)
-				, ready(false)
+			typedef null_lock lock_type;
+
+			static long load(const volatile long* p)
 			{
+				return *p;
 			}
 
-			void add_ref()
+			static void store(volatile long* p, long value)
 			{
-				refcnt.incr();
+				*p = value;
 			}
 
-			void dec_ref()
+			static long compare_exchange(volatile long* p, long expected, long desired)
 			{
-				if (0 == refcnt.decr())
-				{
-					delete this;
-				}
+				const long prev = *p;
+				if (prev == expected)
+					*p = desired;
+				return prev;
 			}
 
-			void set_value()
+			static long fetch_add(volatile long* p, long value)
 			{
-				unique_lock<mutex> lock(mtx);
-				set_value_with_lock();
+				const long prev = *p;
+				*p = prev + value;
+				return prev;
 			}
+		};
 
-			void get_value(bool allow_multiple_gets)
-			{
-				unique_lock<mutex> lock(mtx);
-				if (retrieved && !allow_multiple_gets)
-					detail::throw_future_error("future already retreived");
+		/**
+		 * Mutex and condition variable created for a state the first
+		 * time a thread actually has to block on it. States that are
+		 * ready before anyone waits never construct either.
+		 */
+		struct future_blocker
+		{
+			mutex mtx;
+			condition_variable cond;
+		};
 
-				while (!ready)
-					cond.wait(lock);
+		/**
+		 * Reference count, readiness flags and waiters common to every
+		 * future_state<T, Policy>. The state's mutex and condition variable are
+		 * created lazily by the first waiter that finds it not ready, so
+		 * a state set before it is waited on only ever touches a lock
+		 * word. With MIN11_HAS_PADDED_FUTURE_STATE, the reference count
+		 * (written by every shared_future copy), the lock and waiter list
+		 * (written by every blocking waiter) and the readiness block
+		 * (read by every get) are kept on separate cache lines, and the
+		 * derived state's value starts on a line of its own.
+		 */
+		template<typename Policy>
+		class future_state_base
+		{
+			typedef future_sync<Policy> sync;
 
-				if (retrieved && !allow_multiple_gets)
-					detail::throw_future_error("future already retreived");
+		public:
+			typedef typename sync::lock_type lock_type;
 
-				retrieved = true;
+			// add a reference on behalf of a future, shared_future or
+			// other consumer of the value
+			void add_ref()
+			{
+				sync::fetch_add(&owners, consumer_ref);
 			}
 
-			void wait()
+			bool is_ready() const
 			{
-				unique_lock<mutex> lock(mtx);
-				while (!ready)
-					cond.wait(lock);
+				return state_ready == sync::load(&status);
 			}
 
-			template<typename Func>
-#if MIN11_HAS_RVALREFS
-			void set_continuation(Func&& f)
-#else
-			void set_continuation(const Func& f)
-#endif
+			void wait()
 			{
-				unique_lock<mutex> lock(mtx);
+				if (is_ready())
+					return;
 
-				if (cont)
-					detail::throw_future_error("continuation state already set");
-				if (retrieved)
-					detail::throw_future_error("future already retrieved");
+				unique_lock<lock_type> lock(guard);
+				wait_with_lock(lock);
+			}
 
-				if (ready)
+			// add the reference of a future the promise is handing out.
+			// Until the first future exists the promise is the state's only
+			// owner, so that reference needs no locked instruction.
+			void attach_future()
+			{
+				if (future_attached)
 				{
-					retrieved = true;
-					f();
+					add_ref();
+					return;
 				}
-				else
+
+				future_attached = true;
+				owners = owners + consumer_ref;
+			}
+
+			// stop state requested once every future sharing this state
+			// has been released. Only called by the promise.
+			stop_state* consumers_stop_state()
+			{
+				stop_state* s = atomic_load(&abandon);
+				if (!s)
+				{
+					s = new stop_state;
+					atomic_store(&abandon, s);
+
+					long old = sync::load(&owners);
+					for (;;)
+					{
+						const long prev = sync::compare_exchange(&owners, old, old | abandon_armed);
+						if (prev == old)
+							break;
+						old = prev;
+					}
+
+					// consumers may have left before the state was armed
+					if (future_attached && old < consumer_ref)
+						s->request_stop();
+				}
+
+				return s;
+			}
+
+			// register `w' to be notified once the state is ready. Returns
+			// false without registering if the state is already ready.
+			bool add_waiter(future_waiter* w)
+			{
+				if (is_ready())
+					return false;
+
+				unique_lock<lock_type> lock(guard);
+				if (is_ready())
+					return false;
+
+				w->next = waiters;
+				waiters = w;
+				return true;
+			}
+
+		protected:
+			static bool add_waiter_to(void* state, future_waiter* w)
+			{
+				return static_cast<future_state_base*>(state)->add_waiter(w);
+			}
+
+			future_state_base()
+				: owners(promise_ref)
+				, abandon(0)
+				, future_attached(false)
+				, blocker(0)
+				, waiters(0)
+				, retrieved(false)
+				, status(state_empty)
+				, error(0)
+			{
+			}
+
+			~future_state_base()
+			{
+				if (abandon)
+					abandon->dec_ref();
+				delete blocker;
+				delete error;
+			}
+
+			// Readiness: a setter moves the state from `state_empty' to
+			// `state_setting' before storing the value outside the lock,
+			// then to `state_ready'.
+			enum
+			{
+				state_empty,
+				state_setting,
+				state_ready
+			};
+
+			// reserve the right to set the state. `e' is owned by the
+			// state even if this throws.
+			void claim(future_exception* e = 0)
+			{
+				if (state_empty != sync::compare_exchange(&status, state_empty, state_setting))
+				{
+					delete e;
+					detail::throw_future_error("future state already set");
+				}
+
+				error = e;
+			}
+
+			// mark a claimed state ready, returning the waiters and the
+			// blocker (if any) to wake once the lock is dropped
+			future_waiter* mark_ready_with_lock(future_blocker*& b)
+			{
+				sync::store(&status, state_ready);
+				b = blocker;
+				return take_waiters_with_lock();
+			}
+
+			static void wake(future_blocker* b, future_waiter* w)
+			{
+				if (b)
+				{
+					unique_lock<mutex> lock(b->mtx);
+					b->cond.notify_all();
+				}
+				notify_waiters(w);
+			}
+
+			future_waiter* take_waiters_with_lock()
+			{
+				future_waiter* w = waiters;
+				waiters = 0;
+				return w;
+			}
+
+			static void notify_waiters(future_waiter* w)
+			{
+				while (w)
+				{
+					// the waiter may be destroyed by notify()
+					future_waiter* next = w->next;
+					w->notify();
+					w = next;
+				}
+			}
+
+			// Ownership word: the promise holds `promise_ref', every
+			// consumer one `consumer_ref'. `abandon_armed' is set once the
+			// promise has asked to be told when all consumers are gone.
+			enum
+			{
+				promise_ref = 1,
+				abandon_armed = 2,
+				consumer_ref = 4
+			};
+
+			// release a consumer reference; returns true if it was the
+			// last reference of any kind
+			bool release_ref()
+			{
+				// with no other owner left nobody can add a reference
+				// either, so the last owner skips the read-modify-write
+				long old = sync::load(&owners);
+				if ((old & ~abandon_armed) == consumer_ref)
+					return true;
+
+				for (;;)
+				{
+					// the last consumer requests stop while it still holds
+					// its reference, so the state cannot be freed under it
+					if ((old & promise_ref) && (old & abandon_armed) && (old & ~(promise_ref | abandon_armed)) == consumer_ref)
+						atomic_load(&abandon)->request_stop();
+
+					const long prev = sync::compare_exchange(&owners, old, old - consumer_ref);
+					if (prev == old)
+						return 0 == ((old - consumer_ref) & ~abandon_armed);
+					old = prev;
+				}
+			}
+
+			// release the promise's reference; returns true if it was the
+			// last reference of any kind
+			bool release_promise_ref()
+			{
+				if ((sync::load(&owners) & ~abandon_armed) == promise_ref)
+					return true;
+
+				const long now = sync::fetch_add(&owners, -promise_ref) - promise_ref;
+				return 0 == (now & ~abandon_armed);
+			}
+
+			// wait until the state is ready, as selected by `Policy'. The
+			// state's lock is dropped while waiting and held again on
+			// return.
+			void wait_with_lock(unique_lock<lock_type>& lock)
+			{
+				if (!is_ready())
+					wait_until_ready(lock, Policy());
+			}
+
+			void wait_until_ready(unique_lock<lock_type>& lock, future_policy::blocking)
+			{
+				block_until_ready(lock);
+			}
+
+			void wait_until_ready(unique_lock<lock_type>& lock, future_policy::spin)
+			{
+				lock.mutex()->unlock();
+				while (!is_ready())
+					cpu_relax();
+				lock.mutex()->lock();
+			}
+
+			void wait_until_ready(unique_lock<lock_type>& lock, future_policy::hybrid)
+			{
+				lock.mutex()->unlock();
+				for (int spins = 0; spins < future_policy::hybrid::spin_count && !is_ready(); ++spins)
+					cpu_relax();
+				lock.mutex()->lock();
+
+				block_until_ready(lock);
+			}
+
+			void wait_until_ready(unique_lock<lock_type>&, future_policy::single_threaded)
+			{
+				// nothing else can set the state while this thread waits
+				detail::throw_future_error("single_threaded future is not ready");
+			}
+
+			void block_until_ready(unique_lock<lock_type>& lock)
+			{
+				if (is_ready())
+					return;
+
+				// a fiber is suspended instead of the thread running it
+				if (wait_hook* hook = current_wait_hook())
+				{
+					lock.mutex()->unlock();
+					hook->suspend(&future_state_base::add_waiter_to, this);
+					lock.mutex()->lock();
+					return;
+				}
+
+				future_blocker* b = blocker;
+				if (!b)
+				{
+					b = new future_blocker;
+					blocker = b;
+				}
+
+				// the setter stores `status' before taking `b->mtx', so
+				// checking it under `b->mtx' cannot miss the wakeup
+				lock.mutex()->unlock();
+				{
+					unique_lock<mutex> block(b->mtx);
+					while (!is_ready())
+						b->cond.wait(block);
+				}
+				lock.mutex()->lock();
+			}
+
+			void check_retrieved(bool allow_multiple_gets) const
+			{
+				if (!allow_multiple_gets && retrieved)
+					detail::throw_future_error("future already retreived");
+			}
+
+			// mark the result taken. Shared gets leave `retrieved' alone,
+			// so concurrent readers of a ready state never write to it.
+			void mark_retrieved(bool allow_multiple_gets)
+			{
+				if (!allow_multiple_gets)
+					retrieved = true;
+			}
+
+			// take the result of a ready state without locking `guard':
+			// once ready, the value and error are never written again.
+			// Returns false if the state is not ready yet.
+			bool retrieve_if_ready(bool allow_multiple_gets)
+			{
+				if (!is_ready())
+					return false;
+
+				check_retrieved(allow_multiple_gets);
+				mark_retrieved(allow_multiple_gets);
+				rethrow_with_lock();
+				return true;
+			}
+
+			void rethrow_with_lock() const
+			{
+				if (error)
+					error->rethrow();
+			}
+
+			volatile long owners;
+			stop_state* volatile abandon;
+			bool future_attached;
+#if MIN11_HAS_PADDED_FUTURE_STATE
+			char owners_pad[MIN11_CACHE_LINE_SIZE];
+#endif
+			lock_type guard;
+			future_blocker* blocker;
+			future_waiter* waiters;
+			bool retrieved;
+#if MIN11_HAS_PADDED_FUTURE_STATE
+			char guard_pad[MIN11_CACHE_LINE_SIZE];
+#endif
+			// read-mostly once ready: a get on a ready state reads only
+			// these and the value
+			volatile long status;
+			future_exception* error;
+#if MIN11_HAS_PADDED_FUTURE_STATE
+			char ready_pad[MIN11_CACHE_LINE_SIZE];
+#endif
+
+		private:
+			future_state_base(const future_state_base&); // = delete;
+			future_state_base& operator=(const future_state_base&); // = delete;
+		};
+
+#if MIN11_HAS_FUTURE_CONTINUATIONS
+		/**
+		 * Task invoking a continuation with the value held by a state.
+		 * Keeps the state alive until the continuation has run.
+		 */
+		template<typename T, typename Policy, typename Func>
+		class continuation_task : public task
+		{
+		public:
+			continuation_task(future_state<T, Policy>* state, const Func& f)
+				: state(state)
+				, f(f)
+			{
+				state->add_ref();
+			}
+
+			virtual void run()
+			{
+				state->run_continuation(f);
+				state->dec_ref();
+				delete this;
+			}
+
+		private:
+			future_state<T, Policy>* state;
+			Func f;
+		};
+
+		/**
+		 * Continuation stored in a state that forwards the real
+		 * continuation to an executor
+		 */
+		template<typename T, typename Policy, typename Executor, typename Func>
+		class executor_continuation
+		{
+		public:
+			executor_continuation(Executor& ex, future_state<T, Policy>* state, const Func& f)
+				: ex(&ex)
+				, state(state)
+				, f(f)
+			{
+			}
+
+			void operator()() const
+			{
+				ex->submit(new continuation_task<T, Policy, Func>(state, f));
+			}
+
+			template<typename V>
+			void operator()(const V&) const
+			{
+				ex->submit(new continuation_task<T, Policy, Func>(state, f));
+			}
+
+		private:
+			Executor* ex;
+			future_state<T, Policy>* state;
+			Func f;
+		};
+#endif
+
+		template<typename T, typename Policy>
+		class future_state : public future_state_base<Policy>
+		{
+			friend class future<T, Policy>;
+			friend class shared_future<T, Policy>;
+
+			typedef future_state_base<Policy> base;
+			typedef typename base::lock_type lock_type;
+			using base::guard;
+			using base::error;
+			using base::retrieved;
+			using base::claim;
+			using base::mark_ready_with_lock;
+			using base::wake;
+			using base::check_retrieved;
+			using base::mark_retrieved;
+			using base::retrieve_if_ready;
+			using base::wait_with_lock;
+			using base::rethrow_with_lock;
+			using base::release_ref;
+			using base::release_promise_ref;
+
+		public:
+			using base::is_ready;
+
+			future_state()
+			{
+			}
+
+			void dec_ref()
+			{
+				if (release_ref())
 				{
+					delete this;
+				}
+			}
+
+			void release_promise()
+			{
+				if (release_promise_ref())
+				{
+					delete this;
+				}
+			}
+
 #if MIN11_HAS_RVALREFS
-					cont = std::move(f);
+			void set_value(T&& v)
+			{
+				claim();
+				value = std::move(v);
+				publish();
+			}
+#endif
+			void set_value(const T& v)
+			{
+				claim();
+				value = v;
+				publish();
+			}
+
+			// store `e' (owned by the state) in place of the value
+			void set_exception(future_exception* e)
+			{
+				claim(e);
+				publish();
+			}
+
+			T& get_value(bool allow_multiple_gets)
+			{
+				if (retrieve_if_ready(allow_multiple_gets))
+					return value;
+
+				unique_lock<lock_type> lock(guard);
+				check_retrieved(allow_multiple_gets);
+				wait_with_lock(lock);
+				check_retrieved(allow_multiple_gets);
+
+				mark_retrieved(allow_multiple_gets);
+				rethrow_with_lock();
+				return value;
+			}
+
+#if MIN11_HAS_FUTURE_CONTINUATIONS
+			// the continuation is not run if the state holds an exception
+			template<typename Func>
+#if MIN11_HAS_RVALREFS
+			void set_continuation(Func&& f)
+#else
+			void set_continuation(const Func& f)
+#endif
+			{
+				{
+					unique_lock<lock_type> lock(guard);
+
+					if (cont)
+						detail::throw_future_error("continuation state already set");
+					if (retrieved)
+						detail::throw_future_error("future already retrieved");
+
+					if (!is_ready())
+					{
+#if MIN11_HAS_RVALREFS
+						cont = std::move(f);
+#else
+						cont = f;
+#endif
+						return;
+					}
+
+					retrieved = true;
+				}
+
+				if (!error)
+				{
+#if MIN_HAS_RVALREFS
+					f(std::move(value));
 #else
-					cont = f;
+					f(value);
 #endif
 				}
 			}
 
+			template<typename Executor, typename Func>
+			void set_continuation(Executor& ex, const Func& f)
+			{
+				set_continuation(executor_continuation<T, Policy, Executor, Func>(ex, this, f));
+			}
+
+			template<typename Func>
+			void run_continuation(Func& f)
+			{
+#if MIN11_HAS_RVALREFS
+				f(std::move(value));
+#else
+				f(value);
+#endif
+			}
+#endif
+
 		private:
-			future_state(const future_state&); // = delete;
-			future_state& operator=(const future_state&); // = delete;
+			void publish()
+			{
+				future_blocker* b;
+				future_waiter* w;
+				{
+					unique_lock<lock_type> lock(guard);
+					w = mark_ready_with_lock(b);
+				}
+
+				// a continuation stored before the state became ready is
+				// never replaced afterwards
+#if MIN11_HAS_FUTURE_CONTINUATIONS
+#if MIN11_HAS_RVALREFS
+				if (cont && !error)
+					cont(std::move(value));
+#else
+				if (cont && !error)
+					cont(value);
+#endif
+#endif
+				wake(b, w);
+			}
+
+			T value;
+#if MIN11_HAS_FUTURE_CONTINUATIONS
+#if MIN11_HAS_RVALUES
+			std::function<void(T&&)> cont;
+#else
+			std::function<void(const T&)> cont;
+#endif
+#endif
+		};
 
-			void set_value_with_lock()
+		template<typename Policy>
+		class future_state<void, Policy> : public future_state_base<Policy>
+		{
+			friend class future<void, Policy>;
+			friend class shared_future<void, Policy>;
+
+			typedef future_state_base<Policy> base;
+			typedef typename base::lock_type lock_type;
+			using base::guard;
+			using base::error;
+			using base::retrieved;
+			using base::claim;
+			using base::mark_ready_with_lock;
+			using base::wake;
+			using base::check_retrieved;
+			using base::mark_retrieved;
+			using base::retrieve_if_ready;
+			using base::wait_with_lock;
+			using base::rethrow_with_lock;
+			using base::release_ref;
+			using base::release_promise_ref;
+
+		public:
+			using base::is_ready;
+
+			future_state()
 			{
-				if (ready)
-					detail::throw_future_error("future state already set");
+			}
 
-				ready = true;
-				notify_with_lock();
+			void dec_ref()
+			{
+				if (release_ref())
+				{
+					delete this;
+				}
 			}
 
-			void notify_with_lock()
+			void release_promise()
 			{
+				if (release_promise_ref())
+				{
+					delete this;
+				}
+			}
+
+			void set_value()
+			{
+				claim();
+				publish();
+			}
+
+			// store `e' (owned by the state) in place of the value
+			void set_exception(future_exception* e)
+			{
+				claim(e);
+				publish();
+			}
+
+			void get_value(bool allow_multiple_gets)
+			{
+				if (retrieve_if_ready(allow_multiple_gets))
+					return;
+
+				unique_lock<lock_type> lock(guard);
+				check_retrieved(allow_multiple_gets);
+				wait_with_lock(lock);
+				check_retrieved(allow_multiple_gets);
+
+				mark_retrieved(allow_multiple_gets);
+				rethrow_with_lock();
+			}
+
+#if MIN11_HAS_FUTURE_CONTINUATIONS
+			// the continuation is not run if the state holds an exception
+			template<typename Func>
+#if MIN11_HAS_RVALREFS
+			void set_continuation(Func&& f)
+#else
+			void set_continuation(const Func& f)
+#endif
+			{
+				{
+					unique_lock<lock_type> lock(guard);
+
+					if (cont)
+						detail::throw_future_error("continuation state already set");
+					if (retrieved)
+						detail::throw_future_error("future already retrieved");
+
+					if (!is_ready())
+					{
+#if MIN11_HAS_RVALREFS
+						cont = std::move(f);
+#else
+						cont = f;
+#endif
+						return;
+					}
+
+					retrieved = true;
+				}
+
+				if (!error)
+					f();
+			}
+
+			template<typename Executor, typename Func>
+			void set_continuation(Executor& ex, const Func& f)
+			{
+				set_continuation(executor_continuation<void, Policy, Executor, Func>(ex, this, f));
+			}
+
+			template<typename Func>
+			void run_continuation(Func& f)
+			{
+				f();
+			}
+#endif
+
+		private:
+			void publish()
+			{
+				future_blocker* b;
+				future_waiter* w;
+				{
+					unique_lock<lock_type> lock(guard);
+					w = mark_ready_with_lock(b);
+				}
+
 #if MIN11_HAS_FUTURE_CONTINUATIONS
-				if (cont)
+				if (cont && !error)
 					cont();
 #endif
-				cond.notify_all();
+				wake(b, w);
 			}
 
-			detail::atomic_counter refcnt;
-			mutex mtx;
-			condition_variable cond;
 #if MIN11_HAS_FUTURE_CONTINUATIONS
 			std::function<void()> cont;
 #endif
-			bool retrieved;
-			volatile bool ready;
 		};
 	}
 
-	template<>
-	class future<void>
+#if MIN11_HAS_COROUTINES
+	namespace detail
+	{
+		// state type behind a future awaited by future_awaiter
+		template<typename Future> struct awaited_state;
+
+		template<typename T, typename Policy>
+		struct awaited_state<future<T, Policy> >
+		{
+			typedef future_state<T, Policy> type;
+		};
+
+		template<typename T, typename Policy>
+		struct awaited_state<const shared_future<T, Policy> >
+		{
+			typedef future_state<T, Policy> type;
+		};
+
+		/**
+		 * Awaiter suspending a coroutine until a future's state is ready.
+		 * The coroutine is resumed on the thread that sets the value.
+		 */
+		template<typename Future>
+		class future_awaiter : public future_waiter
+		{
+			typedef typename awaited_state<Future>::type state_type;
+
+		public:
+			future_awaiter(Future& f, state_type* state)
+				: f(&f)
+				, state(state)
+			{
+			}
+
+			bool await_ready() const
+			{
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> h)
+			{
+				handle = h;
+				return state->add_waiter(this);
+			}
+
+			decltype(auto) await_resume()
+			{
+				return f->get();
+			}
+
+			virtual void notify()
+			{
+				handle.resume();
+			}
+
+		private:
+			Future* f;
+			state_type* state;
+			std::coroutine_handle<> handle;
+		};
+	}
+#endif
+
+	template<typename Policy>
+	class future<void, Policy>
 	{
-		friend class promise<void>;
-		friend class shared_future<void>;
+		friend class promise<void, Policy>;
+		friend class shared_future<void, Policy>;
 #if !MIN11_HAS_RVALREFS
-		friend class detail::movable_future<void>;
+		friend class detail::movable_future<void, Policy>;
 #endif
 	public:
 		future()
@@ -726,14 +1748,14 @@ namespace min11
 		}
 
 #if MIN11_HAS_RVALREFS
-		future(future<void>&& rhs)
+		future(future<void, Policy>&& rhs)
 			: state(rhs.state)
 		{
 			rhs.state = 0;
 		}
 
 #else
-		future(const detail::movable_future<void>& rhs)
+		future(const detail::movable_future<void, Policy>& rhs)
 			: state(rhs.state)
 		{
 			rhs.state = 0;
@@ -747,14 +1769,14 @@ namespace min11
 		}
 
 #if MIN11_HAS_RVALREFS
-		future& operator=(future<void>&& rhs)
+		future& operator=(future<void, Policy>&& rhs)
 		{
 			state = rhs.state;
 			rhs.state = 0;
 			return *this;
 		}
 #else
-		future& operator=(const detail::movable_future<void>& rhs)
+		future& operator=(const detail::movable_future<void, Policy>& rhs)
 		{
 			state = rhs.state;
 			rhs.state = 0;
@@ -782,7 +1804,17 @@ namespace min11
 			state->wait();
 		}
 
-		shared_future<void> share();
+		shared_future<void, Policy> share();
+
+#if MIN11_HAS_COROUTINES
+		detail::future_awaiter<future<void, Policy> > operator co_await()
+		{
+			if (!valid())
+				detail::throw_future_error("future has no state object, likely shared");
+
+			return detail::future_awaiter<future<void, Policy> >(*this, state);
+		}
+#endif
 
 #if MIN11_HAS_FUTURE_CONTINUATIONS
 		template<typename Func>
@@ -801,27 +1833,40 @@ namespace min11
 			state->set_continuation(f);
 #endif
 		}
+
+		/**
+		 * Run `f' on the executor `ex' once the state is set, instead
+		 * of on the thread setting the value. `ex' must outlive the
+		 * state.
+		 */
+		template<typename Executor, typename Func>
+		void set_continuation(Executor& ex, const Func& f)
+		{
+			if (!valid())
+				detail::throw_future_error("future has no state object, likely shared");
+
+			state->set_continuation(ex, f);
+		}
 #endif
 
 	private:
 		explicit future(const future&); // = delete;
 		future& operator=(const future&); // = delete;
 
-		future(detail::future_state<void>* s)
+		// adopts the reference added by future_state::attach_future
+		future(detail::future_state<void, Policy>* s)
 			: state(s)
 		{
-			if (s)
-				s->add_ref();
 		}
 
-		detail::future_state<void>* state;
+		detail::future_state<void, Policy>* state;
 	};
 
 	/**
 	 * Minimal emulation for std::shared_future
 	 */
-	template<>
-	class shared_future<void>
+	template<typename Policy>
+	class shared_future<void, Policy>
 	{
 	public:
 		shared_future()
@@ -830,7 +1875,7 @@ namespace min11
 		}
 
 #if MIN11_HAS_RVALREFS
-		shared_future(future<void>&& rhs)
+		shared_future(future<void, Policy>&& rhs)
 			: state(0)
 		{
 #if MIN11_HAS_FUTURE_CONTINUATIONS
@@ -841,13 +1886,13 @@ namespace min11
 			rhs.state = 0;
 		}
 
-		shared_future(shared_future<void>&& rhs)
+		shared_future(shared_future<void, Policy>&& rhs)
 			: state(rhs.state)
 		{
 			rhs.state = 0;
 		}
 #else
-		shared_future(const detail::movable_future<void>& rhs)
+		shared_future(const detail::movable_future<void, Policy>& rhs)
 			: state(0)
 		{
 #if MIN11_HAS_FUTURE_CONTINUATIONS
@@ -859,7 +1904,7 @@ namespace min11
 		}
 #endif
 
-		shared_future(const shared_future<void>& other)
+		shared_future(const shared_future<void, Policy>& other)
 			: state(other.state)
 		{
 			if (state)
@@ -883,7 +1928,7 @@ namespace min11
 		}
 
 #if MIN11_HAS_RVALREFS
-		shared_future& operator=(future<void>&& rhs)
+		shared_future& operator=(future<void, Policy>&& rhs)
 		{
 			if (state)
 				state->dec_ref();
@@ -898,7 +1943,7 @@ namespace min11
 			return *this;
 		}
 
-		shared_future& operator=(shared_future<void>&& rhs)
+		shared_future& operator=(shared_future<void, Policy>&& rhs)
 		{
 			if (state)
 				state->dec_ref();
@@ -908,7 +1953,7 @@ namespace min11
 			return *this;
 		}
 #else
-		shared_future& operator=(const detail::movable_future<void>& rhs)
+		shared_future& operator=(const detail::movable_future<void, Policy>& rhs)
 		{
 			if (state)
 				state->dec_ref();
@@ -945,25 +1990,35 @@ namespace min11
 			state->get_value(true);
 		}
 
+#if MIN11_HAS_COROUTINES
+		detail::future_awaiter<const shared_future<void, Policy> > operator co_await() const
+		{
+			if (!valid())
+				detail::throw_future_error("future has no state object");
+
+			return detail::future_awaiter<const shared_future<void, Policy> >(*this, state);
+		}
+#endif
+
 	private:
-		detail::future_state<void>* state;
+		detail::future_state<void, Policy>* state;
 	};
 
 	/**
 	 * Minimal emulation of std::promise
 	 */
-	template<>
-	class promise<void>
+	template<typename Policy>
+	class promise<void, Policy>
 	{
 	public:
 		promise()
-			: state(new detail::future_state<void>)
+			: state(new detail::future_state<void, Policy>)
 		{
 		}
 
 		~promise()
 		{
-			state->dec_ref();
+			state->release_promise();
 		}
 
 		void set_value()
@@ -971,28 +2026,109 @@ namespace min11
 			state->set_value();
 		}
 
+		/**
+		 * Store a copy of `e' in place of the value. Every get() on a
+		 * future sharing the state throws a copy of it.
+		 */
+		template<typename E>
+		void set_exception(const E& e)
+		{
+			state->set_exception(new detail::typed_future_exception<E>(e));
+		}
+
+#if MIN11_HAS_EXCEPTION_PTR
+		void set_exception(std::exception_ptr p)
+		{
+			state->set_exception(new detail::future_exception_ptr(p));
+		}
+#endif
+
 #if MIN11_HAS_RVALREFS
-		future<void> get_future()
+		future<void, Policy> get_future()
 		{
-			return future<void>(state);
+			state->attach_future();
+			return future<void, Policy>(state);
 		}
 #else
-		detail::movable_future<void> get_future()
+		detail::movable_future<void, Policy> get_future()
 		{
-			return detail::movable_future<void>(state);
+			state->attach_future();
+			return detail::movable_future<void, Policy>(state);
 		}
 #endif
 
+		// stop token requested once every future obtained from this
+		// promise, and every shared_future copied from those, has been
+		// released: nobody is left to observe the value
+		stop_token get_stop_token()
+		{
+			return stop_token(state->consumers_stop_state());
+		}
+
 	private:
 		promise(const promise&); // = delete;
 		promise& operator=(const promise&); // = delete;
 
-		detail::future_state<void>* state;
+		detail::future_state<void, Policy>* state;
 	};
 
-	inline shared_future<void> future<void>::share()
+	template<typename Policy>
+	shared_future<void, Policy> future<void, Policy>::share()
+	{
+		return shared_future<void, Policy>(move(*this));
+	}
+
+	/**
+	 * Create a future that is already ready with `value'. The state is
+	 * set before any consumer can see it, so it never creates a mutex
+	 * or condition variable.
+	 */
+#if MIN11_HAS_RVALREFS
+	template<typename T>
+	future<typename std::decay<T>::type> make_ready_future(T&& value)
+	{
+		promise<typename std::decay<T>::type> p;
+		p.set_value(std::forward<T>(value));
+		return p.get_future();
+	}
+
+	inline future<void> make_ready_future()
+	{
+		promise<void> p;
+		p.set_value();
+		return p.get_future();
+	}
+#else
+	template<typename T>
+	detail::movable_future<T> make_ready_future(const T& value)
+	{
+		promise<T> p;
+		p.set_value(value);
+		return p.get_future();
+	}
+
+	inline detail::movable_future<void> make_ready_future()
+	{
+		promise<void> p;
+		p.set_value();
+		return p.get_future();
+	}
+#endif
+
+	/**
+	 * Create a future whose get() throws a copy of `e'. As with
+	 * make_ready_future, no blocking primitives are created.
+	 */
+	template<typename T, typename E>
+#if MIN11_HAS_RVALREFS
+	future<T> make_exceptional_future(const E& e)
+#else
+	detail::movable_future<T> make_exceptional_future(const E& e)
+#endif
 	{
-		return shared_future<void>(move(*this));
+		promise<T> p;
+		p.set_exception(e);
+		return p.get_future();
 	}
 
 }
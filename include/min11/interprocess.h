@@ -0,0 +1,307 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__INTERPROCESS_H
+#define MIN11__INTERPROCESS_H
+
+#include "config.h"
+
+#if MIN11_HAS_INTERPROCESS
+
+#include "atomic.h"
+
+#include <stddef.h> // size_t
+#include <string.h> // memcpy
+
+#if MIN11_HAS_EXCEPTIONS
+#	include <stdexcept>
+#endif
+
+namespace min11
+{
+	/**
+	 * Thrown when a shared memory segment cannot be created or opened
+	 */
+#if MIN11_HAS_EXCEPTIONS
+	struct interprocess_error
+		: public std::runtime_error
+	{
+		interprocess_error(const char* message)
+			: std::runtime_error(message)
+		{
+		}
+	};
+#endif
+
+	namespace detail
+	{
+		struct arena_internal;
+
+		// process-shared mutex and condition variable placed inside a
+		// shared memory segment
+		size_t interprocess_sync_size();
+		void interprocess_sync_init(void* sync);
+
+		// block until *ready is non-zero
+		void interprocess_sync_wait(void* sync, const volatile long* ready);
+
+		// set *ready and wake every waiting process
+		void interprocess_sync_notify(void* sync, volatile long* ready);
+
+		/**
+		 * Layout of an interprocess state inside an arena: this header,
+		 * the synchronization objects, then the payload, each starting
+		 * on a cache line
+		 */
+		struct interprocess_state
+		{
+			volatile long ready;
+			volatile long initialized;
+
+			enum
+			{
+				magic = 0x6d31316c
+			};
+
+			static size_t align(size_t n)
+			{
+				return (n + MIN11_CACHE_LINE_SIZE - 1) & ~static_cast<size_t>(MIN11_CACHE_LINE_SIZE - 1);
+			}
+
+			static size_t sync_offset()
+			{
+				return align(sizeof(interprocess_state));
+			}
+
+			static size_t payload_offset()
+			{
+				return align(sync_offset() + interprocess_sync_size());
+			}
+
+			static size_t required_size(size_t payload)
+			{
+				return payload_offset() + payload;
+			}
+
+			void* sync()
+			{
+				return reinterpret_cast<char*>(this) + sync_offset();
+			}
+
+			void* payload()
+			{
+				return reinterpret_cast<char*>(this) + payload_offset();
+			}
+		};
+	}
+
+	/**
+	 * Named POSIX shared memory segment mapped into this process. Space
+	 * is handed out by a bump allocator whose cursor lives in the
+	 * segment, so every process mapping it agrees on offsets. Offsets,
+	 * not pointers, are exchanged between processes: each process may
+	 * map the segment at a different address.
+	 */
+	class shared_memory_arena
+	{
+	public:
+		enum open_mode
+		{
+			create_only, // fail if the segment exists
+			open_only // fail unless the segment exists
+		};
+
+		// `size' is used only when creating the segment
+		shared_memory_arena(const char* name, size_t size, open_mode mode);
+
+		// unmaps the segment; it persists until remove()
+		~shared_memory_arena();
+
+		// remove a segment's name; existing mappings stay valid
+		static bool remove(const char* name);
+
+		// reserve `bytes' of the segment. Returns the offset of the
+		// block, or 0 if the segment is full.
+		size_t allocate(size_t bytes);
+
+		void* address(size_t offset) const;
+
+		size_t size() const;
+
+	private:
+		shared_memory_arena(const shared_memory_arena&); // = delete;
+		shared_memory_arena& operator=(const shared_memory_arena&); // = delete;
+
+		detail::arena_internal* a;
+	};
+
+	/**
+	 * Promise whose state and value live in a shared_memory_arena, so a
+	 * future in another process can wait on it and read the value in
+	 * place. T must be trivially copyable.
+	 *
+	 * Construct the promise first, then send offset() to the process
+	 * creating the interprocess_future by any means.
+	 */
+	template<typename T>
+	class interprocess_promise
+	{
+	public:
+		static size_t required_size()
+		{
+			return detail::interprocess_state::required_size(sizeof(T));
+		}
+
+		// allocate a state from `arena'
+		explicit interprocess_promise(shared_memory_arena& arena)
+			: arena(arena)
+			, state_offset(arena.allocate(required_size()))
+		{
+			if (!state_offset)
+				throw_full();
+			init();
+		}
+
+		// construct a state in space at `offset' already reserved with
+		// required_size() bytes
+		interprocess_promise(shared_memory_arena& arena, size_t offset)
+			: arena(arena)
+			, state_offset(offset)
+		{
+			init();
+		}
+
+		size_t offset() const
+		{
+			return state_offset;
+		}
+
+		// storage for the value, to be filled in place before
+		// make_ready()
+		T* data()
+		{
+			return static_cast<T*>(state()->payload());
+		}
+
+		void make_ready()
+		{
+			detail::interprocess_sync_notify(state()->sync(), &state()->ready);
+		}
+
+		void set_value(const T& value)
+		{
+			memcpy(data(), &value, sizeof(T));
+			make_ready();
+		}
+
+		// make the state reusable for another value. Only safe once the
+		// consumer has finished with the previous one.
+		void reset()
+		{
+			detail::atomic_store(&state()->ready, 0);
+		}
+
+	private:
+		interprocess_promise(const interprocess_promise&); // = delete;
+		interprocess_promise& operator=(const interprocess_promise&); // = delete;
+
+		static void throw_full()
+		{
+#if MIN11_HAS_EXCEPTIONS
+			throw interprocess_error("shared memory arena is full");
+#else
+			MIN11_THROW_EXCEPTION("shared memory arena is full");
+#endif
+		}
+
+		void init()
+		{
+			detail::interprocess_state* s = state();
+			s->ready = 0;
+			detail::interprocess_sync_init(s->sync());
+			detail::atomic_store(&s->initialized, static_cast<long>(detail::interprocess_state::magic));
+		}
+
+		detail::interprocess_state* state() const
+		{
+			return static_cast<detail::interprocess_state*>(arena.address(state_offset));
+		}
+
+		shared_memory_arena& arena;
+		size_t state_offset;
+	};
+
+	/**
+	 * Waits on an interprocess_promise, possibly in another process. The
+	 * value is read in place, without copying it out of the arena.
+	 */
+	template<typename T>
+	class interprocess_future
+	{
+	public:
+		interprocess_future(shared_memory_arena& arena, size_t offset)
+			: arena(arena)
+			, state_offset(offset)
+		{
+		}
+
+		// true once the promise has been constructed at this offset
+		bool valid() const
+		{
+			return detail::interprocess_state::magic == detail::atomic_load(&state()->initialized);
+		}
+
+		bool is_ready() const
+		{
+			return 0 != detail::atomic_load(&state()->ready);
+		}
+
+		void wait() const
+		{
+			if (!is_ready())
+				detail::interprocess_sync_wait(state()->sync(), &state()->ready);
+		}
+
+		const T& get() const
+		{
+			wait();
+			return *static_cast<const T*>(state()->payload());
+		}
+
+	private:
+		detail::interprocess_state* state() const
+		{
+			return static_cast<detail::interprocess_state*>(arena.address(state_offset));
+		}
+
+		shared_memory_arena& arena;
+		size_t state_offset;
+	};
+}
+
+#endif // MIN11_HAS_INTERPROCESS
+
+#endif // MIN11__INTERPROCESS_H
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__IO_REACTOR_H
+#define MIN11__IO_REACTOR_H
+
+#include "config.h"
+
+#if MIN11_HAS_IO_REACTOR
+
+#include "future.h"
+
+#include <stddef.h> // size_t
+
+#if MIN11_HAS_EXCEPTIONS
+#	include <stdexcept>
+#endif
+
+namespace min11
+{
+	/**
+	 * Outcome of an operation started on an io_reactor
+	 */
+	struct io_result
+	{
+		io_result()
+			: bytes(0)
+			, fd(-1)
+			, error(0)
+		{
+		}
+
+		// bytes transferred; 0 from a read means end of file
+		size_t bytes;
+
+		// descriptor accepted by async_accept, otherwise -1
+		int fd;
+
+		// errno value describing a failure, 0 on success
+		int error;
+	};
+
+	/**
+	 * Thrown when the reactor cannot create its epoll instance
+	 */
+#if MIN11_HAS_EXCEPTIONS
+	struct io_error
+		: public std::runtime_error
+	{
+		io_error(const char* message)
+			: std::runtime_error(message)
+		{
+		}
+	};
+#endif
+
+	namespace detail
+	{
+		struct io_reactor_internal;
+	}
+
+	/**
+	 * Completes futures as file descriptors become readable or writable.
+	 *
+	 * Each operation is first attempted on the calling thread; only if it
+	 * would block is it queued on the descriptor and handed to epoll, and
+	 * its future completed by whichever thread is inside run() when the
+	 * descriptor becomes ready. A descriptor is switched to non-blocking
+	 * mode by its first operation, and what the reactor learns about it
+	 * is kept until cancel(fd). Operations on the same descriptor and
+	 * direction complete in the order they were started.
+	 *
+	 * Call cancel(fd) before closing a descriptor used with the reactor,
+	 * so that a file later reusing the number is probed afresh.
+	 */
+	class io_reactor
+	{
+	public:
+#if MIN11_HAS_RVALREFS
+		typedef future<io_result> result_future;
+#else
+		typedef detail::movable_future<io_result> result_future;
+#endif
+
+		io_reactor();
+		~io_reactor();
+
+		// read up to `size' bytes into `buf', which must remain valid
+		// until the future is ready
+		result_future async_read(int fd, void* buf, size_t size);
+
+		// write up to `size' bytes from `buf', which must remain valid
+		// until the future is ready. As write(2), fewer bytes than
+		// requested may be written.
+		result_future async_write(int fd, const void* buf, size_t size);
+
+		// accept a connection on the listening socket `fd'. The new
+		// descriptor is non-blocking and close-on-exec.
+		result_future async_accept(int fd);
+
+		// complete every pending operation on `fd' with ECANCELED, stop
+		// watching it and forget what was learnt about the file
+		void cancel(int fd);
+
+		// dispatch readiness until stop() is called. Several threads
+		// may run the same reactor.
+		void run();
+
+		// wait up to `timeout_ms' (-1 waits indefinitely) for ready
+		// descriptors and complete their operations. Returns the number
+		// of operations completed.
+		size_t run_once(int timeout_ms = -1);
+
+		// make run() return in every thread running the reactor
+		void stop();
+
+	private:
+		io_reactor(const io_reactor&); // = delete;
+		io_reactor& operator=(const io_reactor&); // = delete;
+
+		detail::io_reactor_internal* r;
+	};
+}
+
+#endif // MIN11_HAS_IO_REACTOR
+
+#endif // MIN11__IO_REACTOR_H
@@ -27,13 +27,17 @@
 #ifndef MIN11__MUTEX_H
 #define MIN11__MUTEX_H
 
+#include "config.h"
+
 namespace min11
 {
 	class condition_variable;
 	namespace detail { struct mutex_internal; }
 	
 	/**
-	 * Minimal emulation for std::mutex
+	 * Minimal emulation for std::mutex. A fiber (see fiber.h) finding it
+	 * locked is rescheduled until it is free rather than blocking its
+	 * worker thread.
 	 */
 	class mutex
 	{
@@ -50,6 +54,35 @@ namespace min11
 		mutex(const mutex&); // = delete;
 		mutex& operator=(const mutex&); // = delete
 		
+#if MIN11_HAS_PARKING_LOT
+		volatile unsigned char state;
+#else
+		detail::mutex_internal* m;
+#endif
+	};
+
+	/**
+	 * Mutex using the priority-inheritance protocol. While a thread is
+	 * blocked on the lock, the holder runs at no lower a priority than
+	 * the blocked thread, so a real-time thread cannot be held off by a
+	 * low-priority holder that is itself preempted. Falls back to a plain
+	 * mutex where the platform offers no priority inheritance.
+	 */
+	class pi_mutex
+	{
+		friend class condition_variable;
+	public:
+		pi_mutex();
+		~pi_mutex();
+
+		void lock();
+		bool try_lock();
+		void unlock();
+
+	private:
+		pi_mutex(const pi_mutex&); // = delete;
+		pi_mutex& operator=(const pi_mutex&); // = delete
+
 		detail::mutex_internal* m;
 	};
 	
@@ -0,0 +1,373 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__PARALLEL_H
+#define MIN11__PARALLEL_H
+
+#include "atomic.h"
+#include "condition_variable.h"
+#include "executor.h"
+#include "future.h"
+#include "mutex.h"
+#include "thread.h"
+
+#include <stddef.h> // size_t
+#include <vector>
+
+/**
+ * Data-parallel algorithms
+ *
+ * An index range is cut into chunks of `grain' indices. The calling
+ * thread splits the chunk range in half, submits the upper half to the
+ * executor and keeps splitting the lower half; every task does the same
+ * with the range it receives. Idle workers therefore pick up large
+ * ranges first and split them further, so skewed chunk costs even out.
+ * Completion is tracked by a single counter per call rather than a
+ * future per chunk.
+ *
+ * A grain of 0 selects roughly four chunks per hardware thread. The
+ * calling thread blocks until every chunk has run; a thread_pool worker
+ * runs other tasks meanwhile and a fiber is suspended instead (see
+ * future.h's wait_hook). These must not be called from a task running
+ * on any other single-threaded executor they submit to. Function
+ * objects must not throw.
+ */
+namespace min11
+{
+	namespace detail
+	{
+		/**
+		 * Counts outstanding chunks; wait() returns once all are done
+		 */
+		class completion_counter
+		{
+		public:
+			explicit completion_counter(long count)
+				: count(count)
+				, finished(count == 0)
+				, waiter(0)
+			{
+			}
+
+			// count again from `count'. Only once the previous wait()
+			// has returned, before any done() of the next round.
+			void reset(long count)
+			{
+				unique_lock<mutex> lock(mtx);
+				this->count = count;
+				finished = (count == 0);
+				waiter = 0;
+			}
+
+			void done()
+			{
+				if (1 != atomic_fetch_add(&count, -1))
+					return;
+
+				// signal under the lock: the waiter may destroy the
+				// counter as soon as it observes `finished'
+				future_waiter* w;
+				{
+					unique_lock<mutex> lock(mtx);
+					finished = true;
+					w = waiter;
+					cond.notify_all();
+				}
+
+				if (w)
+					w->notify();
+			}
+
+			void wait()
+			{
+				// pool workers and fibers wait through their hook
+				if (wait_hook* hook = current_wait_hook())
+				{
+					hook->suspend(&completion_counter::add_waiter_to, this);
+					return;
+				}
+
+				unique_lock<mutex> lock(mtx);
+				while (!finished)
+					cond.wait(lock);
+			}
+
+		private:
+			completion_counter(const completion_counter&); // = delete;
+			completion_counter& operator=(const completion_counter&); // = delete;
+
+			static bool add_waiter_to(void* counter, future_waiter* w)
+			{
+				completion_counter* c = static_cast<completion_counter*>(counter);
+				unique_lock<mutex> lock(c->mtx);
+				if (c->finished)
+					return false;
+
+				c->waiter = w;
+				return true;
+			}
+
+			volatile long count;
+			bool finished;
+			future_waiter* waiter;
+			mutex mtx;
+			condition_variable cond;
+		};
+
+		static inline size_t parallel_grain(size_t count, size_t grain)
+		{
+			if (grain)
+				return grain;
+
+			size_t chunks = 4 * hardware_concurrency();
+			if (chunks == 0)
+				chunks = 4;
+
+			grain = count / chunks;
+			return grain ? grain : 1;
+		}
+
+		template<typename Executor, typename Body>
+		void run_chunks(Executor& ex, Body& body, completion_counter& counter, size_t first, size_t last);
+
+		template<typename Executor, typename Body>
+		class chunk_range_task : public task
+		{
+		public:
+			chunk_range_task(Executor& ex, Body& body, completion_counter& counter, size_t first, size_t last)
+				: ex(ex)
+				, body(body)
+				, counter(counter)
+				, first(first)
+				, last(last)
+			{
+			}
+
+			virtual void run()
+			{
+				Executor& e = ex;
+				Body& b = body;
+				completion_counter& c = counter;
+				const size_t f = first;
+				const size_t l = last;
+				delete this;
+
+				run_chunks(e, b, c, f, l);
+			}
+
+		private:
+			Executor& ex;
+			Body& body;
+			completion_counter& counter;
+			size_t first;
+			size_t last;
+		};
+
+		// run chunks [first, last), handing the upper half to the
+		// executor until a single chunk remains
+		template<typename Executor, typename Body>
+		void run_chunks(Executor& ex, Body& body, completion_counter& counter, size_t first, size_t last)
+		{
+			while (last - first > 1)
+			{
+				const size_t mid = first + (last - first) / 2;
+				ex.submit(new chunk_range_task<Executor, Body>(ex, body, counter, mid, last));
+				last = mid;
+			}
+
+			body.run_chunk(first);
+			counter.done();
+		}
+
+		// invoke body.run_chunk(c) for every chunk and wait for them
+		template<typename Executor, typename Body>
+		void run_parallel(Executor& ex, Body& body, size_t chunks)
+		{
+			if (chunks == 0)
+				return;
+
+			completion_counter counter(static_cast<long>(chunks));
+			run_chunks(ex, body, counter, 0, chunks);
+			counter.wait();
+		}
+
+		template<typename Func>
+		class for_body
+		{
+		public:
+			for_body(size_t first, size_t last, size_t grain, const Func& f)
+				: first(first)
+				, last(last)
+				, grain(grain)
+				, f(f)
+			{
+			}
+
+			void run_chunk(size_t chunk)
+			{
+				const size_t begin = first + chunk * grain;
+				const size_t end = (last - begin > grain) ? begin + grain : last;
+				for (size_t ii = begin; ii != end; ++ii)
+					f(ii);
+			}
+
+		private:
+			size_t first;
+			size_t last;
+			size_t grain;
+			const Func& f;
+		};
+
+		template<typename T, typename Func, typename Reduce>
+		class reduce_body
+		{
+		public:
+			reduce_body(size_t first, size_t last, size_t grain, const T& identity, const Func& f, const Reduce& reduce, size_t chunks)
+				: first(first)
+				, last(last)
+				, grain(grain)
+				, f(f)
+				, reduce(reduce)
+				, partials(chunks, identity)
+			{
+			}
+
+			void run_chunk(size_t chunk)
+			{
+				const size_t begin = first + chunk * grain;
+				const size_t end = (last - begin > grain) ? begin + grain : last;
+				T acc = partials[chunk];
+				for (size_t ii = begin; ii != end; ++ii)
+					acc = reduce(acc, f(ii));
+				partials[chunk] = acc;
+			}
+
+			// combine chunk results left to right
+			T result(const T& identity) const
+			{
+				T acc = identity;
+				for (size_t ii = 0; ii < partials.size(); ++ii)
+					acc = reduce(acc, partials[ii]);
+				return acc;
+			}
+
+		private:
+			size_t first;
+			size_t last;
+			size_t grain;
+			const Func& f;
+			const Reduce& reduce;
+			std::vector<T> partials;
+		};
+
+		template<typename InputIt, typename OutputIt, typename Func>
+		class transform_body
+		{
+		public:
+			transform_body(InputIt in, OutputIt out, size_t count, size_t grain, const Func& f)
+				: in(in)
+				, out(out)
+				, count(count)
+				, grain(grain)
+				, f(f)
+			{
+			}
+
+			void run_chunk(size_t chunk)
+			{
+				const size_t begin = chunk * grain;
+				const size_t end = (count - begin > grain) ? begin + grain : count;
+				InputIt src = in + begin;
+				OutputIt dst = out + begin;
+				for (size_t ii = begin; ii != end; ++ii, ++src, ++dst)
+					*dst = f(*src);
+			}
+
+		private:
+			InputIt in;
+			OutputIt out;
+			size_t count;
+			size_t grain;
+			const Func& f;
+		};
+	}
+
+	/**
+	 * Call f(i) for every i in [first, last)
+	 */
+	template<typename Executor, typename Func>
+	void parallel_for(Executor& ex, size_t first, size_t last, const Func& f, size_t grain = 0)
+	{
+		if (last <= first)
+			return;
+
+		const size_t count = last - first;
+		grain = detail::parallel_grain(count, grain);
+
+		detail::for_body<Func> body(first, last, grain, f);
+		detail::run_parallel(ex, body, (count + grain - 1) / grain);
+	}
+
+	/**
+	 * Combine f(i) for every i in [first, last) with reduce(T, T).
+	 * `identity' seeds every chunk, and chunk results are combined in
+	 * index order, so `reduce' need only be associative.
+	 */
+	template<typename Executor, typename T, typename Func, typename Reduce>
+	T parallel_reduce(Executor& ex, size_t first, size_t last, const T& identity, const Func& f, const Reduce& reduce, size_t grain = 0)
+	{
+		if (last <= first)
+			return identity;
+
+		const size_t count = last - first;
+		grain = detail::parallel_grain(count, grain);
+
+		const size_t chunks = (count + grain - 1) / grain;
+		detail::reduce_body<T, Func, Reduce> body(first, last, grain, identity, f, reduce, chunks);
+		detail::run_parallel(ex, body, chunks);
+		return body.result(identity);
+	}
+
+	/**
+	 * Store f(*it) for every `it' in the random access range [first, last)
+	 * to the corresponding position of the range starting at `out'
+	 */
+	template<typename Executor, typename InputIt, typename OutputIt, typename Func>
+	OutputIt parallel_transform(Executor& ex, InputIt first, InputIt last, OutputIt out, const Func& f, size_t grain = 0)
+	{
+		if (!(first < last))
+			return out;
+
+		const size_t count = static_cast<size_t>(last - first);
+		grain = detail::parallel_grain(count, grain);
+
+		detail::transform_body<InputIt, OutputIt, Func> body(first, out, count, grain, f);
+		detail::run_parallel(ex, body, (count + grain - 1) / grain);
+		return out + count;
+	}
+}
+
+#endif // MIN11__PARALLEL_H
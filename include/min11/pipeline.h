@@ -0,0 +1,396 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__PIPELINE_H
+#define MIN11__PIPELINE_H
+
+#include "executor.h"
+#include "mutex.h"
+#include "parallel.h"
+
+#include <stddef.h> // size_t
+#include <vector>
+
+namespace min11
+{
+	template<typename T> class pipeline;
+
+	namespace detail
+	{
+		/**
+		 * How a pipeline stage admits the items passing through it
+		 */
+		struct pipeline_modes
+		{
+			enum stage_mode
+			{
+				serial_in_order, // one item at a time, in input order
+				serial_out_of_order, // one item at a time, in arrival order
+				parallel // any number of items at once
+			};
+		};
+
+		// executor and completion counter of the run in progress
+		struct pipeline_run
+		{
+			void* ex;
+			void (*submit)(void* ex, task* t);
+			completion_counter* counter;
+		};
+
+		/**
+		 * Slot carrying one item through the stages. Tokens are owned by
+		 * their pipeline and reused for every item; the number of tokens
+		 * bounds the items in flight.
+		 */
+		template<typename T>
+		class pipeline_token : public task
+		{
+		public:
+			explicit pipeline_token(pipeline<T>* owner)
+				: owner(owner)
+				, seq(0)
+				, stage(0)
+				, waiting(0)
+			{
+			}
+
+			virtual void run()
+			{
+				owner->advance(this);
+			}
+
+			pipeline<T>* owner;
+			T item;
+			size_t seq; // input order
+			size_t stage; // stage to run next
+			pipeline_token* waiting; // link while queued at a serial stage
+		};
+
+		template<typename T>
+		class pipeline_stage
+		{
+		public:
+			explicit pipeline_stage(pipeline_modes::stage_mode mode)
+				: mode(mode)
+				, busy(false)
+				, next_seq(0)
+				, head(0)
+				, tail(0)
+			{
+			}
+
+			virtual ~pipeline_stage()
+			{
+			}
+
+			// false ends the input; only the input stage returns it
+			virtual bool process(T& item) = 0;
+
+			void reset(size_t ntokens)
+			{
+				busy = false;
+				next_seq = 0;
+				head = 0;
+				tail = 0;
+				if (mode == pipeline_modes::serial_in_order)
+					slots.assign(ntokens, 0);
+			}
+
+			// Claim a serial stage for `tok', or leave `tok' for the thread
+			// currently running the stage. Tokens waiting in order are
+			// slotted by sequence number: at most one token per slot is
+			// in flight.
+			bool enter(pipeline_token<T>* tok)
+			{
+				unique_lock<mutex> lock(mtx);
+				if (mode == pipeline_modes::serial_in_order)
+				{
+					if (busy || tok->seq != next_seq)
+					{
+						slots[tok->seq % slots.size()] = tok;
+						return false;
+					}
+				}
+				else if (busy)
+				{
+					tok->waiting = 0;
+					if (tail)
+						tail->waiting = tok;
+					else
+						head = tok;
+					tail = tok;
+					return false;
+				}
+
+				busy = true;
+				return true;
+			}
+
+			// release the stage after running a token, or hand it to the
+			// waiting token that may run next
+			pipeline_token<T>* leave()
+			{
+				unique_lock<mutex> lock(mtx);
+				pipeline_token<T>* next = 0;
+				if (mode == pipeline_modes::serial_in_order)
+				{
+					pipeline_token<T>*& slot = slots[++next_seq % slots.size()];
+					next = slot;
+					slot = 0;
+				}
+				else if (head)
+				{
+					next = head;
+					head = head->waiting;
+					if (!head)
+						tail = 0;
+				}
+
+				if (!next)
+					busy = false;
+				return next;
+			}
+
+			const pipeline_modes::stage_mode mode;
+
+		private:
+			pipeline_stage(const pipeline_stage&); // = delete;
+			pipeline_stage& operator=(const pipeline_stage&); // = delete;
+
+			mutex mtx;
+			bool busy;
+			size_t next_seq;
+			std::vector<pipeline_token<T>*> slots;
+			pipeline_token<T>* head;
+			pipeline_token<T>* tail;
+		};
+
+		template<typename T, typename Func>
+		class pipeline_input_stage : public pipeline_stage<T>
+		{
+		public:
+			explicit pipeline_input_stage(const Func& f)
+				: pipeline_stage<T>(pipeline_modes::serial_out_of_order)
+				, f(f)
+			{
+			}
+
+			virtual bool process(T& item)
+			{
+				return f(item);
+			}
+
+		private:
+			Func f;
+		};
+
+		template<typename T, typename Func>
+		class pipeline_function_stage : public pipeline_stage<T>
+		{
+		public:
+			pipeline_function_stage(pipeline_modes::stage_mode mode, const Func& f)
+				: pipeline_stage<T>(mode)
+				, f(f)
+			{
+			}
+
+			virtual bool process(T& item)
+			{
+				f(item);
+				return true;
+			}
+
+		private:
+			Func f;
+		};
+	}
+
+	/**
+	 * Chain of stages processing a stream of T on an executor, in the
+	 * manner of TBB's parallel_pipeline. The input function, bool(T&),
+	 * fills an item and returns false once the input is exhausted; every
+	 * later stage, void(T&), transforms the item in place.
+	 *
+	 * A run circulates a fixed number of tokens, each carrying one item
+	 * through every stage and then back to the input, so memory stays
+	 * bounded and the input stalls once `max_tokens' items are in
+	 * flight. Parallel stages run as many items as there are threads.
+	 * A serial stage is run by one thread at a time: a token reaching a
+	 * busy stage is queued rather than blocking its thread, and the
+	 * thread leaving the stage runs the queued tokens itself. Serial
+	 * in-order stages see items in input order.
+	 *
+	 * Items are reused from one input to the next and must be default
+	 * constructible. A pipeline must not be modified or run again while
+	 * a run is in progress. Function objects must not throw.
+	 */
+	template<typename T>
+	class pipeline : public detail::pipeline_modes
+	{
+	public:
+		template<typename Func>
+		explicit pipeline(const Func& input)
+			: exhausted(false)
+			, next_input(0)
+		{
+			stages.push_back(new detail::pipeline_input_stage<T, Func>(input));
+		}
+
+		~pipeline()
+		{
+			for (size_t ii = 0; ii < tokens.size(); ++ii)
+				delete tokens[ii];
+			for (size_t ii = 0; ii < stages.size(); ++ii)
+				delete stages[ii];
+		}
+
+		// append a stage running `f' on every item
+		template<typename Func>
+		void add_stage(stage_mode mode, const Func& f)
+		{
+			stages.push_back(new detail::pipeline_function_stage<T, Func>(mode, f));
+		}
+
+		size_t size() const
+		{
+			return stages.size();
+		}
+
+		// run the input to exhaustion on `ex', with at most `max_tokens'
+		// items in flight, and wait for the last item to finish
+		template<typename Executor>
+		void run(Executor& ex, size_t max_tokens)
+		{
+			if (!max_tokens)
+				max_tokens = 1;
+
+			while (tokens.size() < max_tokens)
+				tokens.push_back(new detail::pipeline_token<T>(this));
+
+			for (size_t ii = 0; ii < stages.size(); ++ii)
+				stages[ii]->reset(max_tokens);
+
+			exhausted = false;
+			next_input = 0;
+
+			detail::completion_counter counter(static_cast<long>(max_tokens));
+			current.ex = &ex;
+			current.submit = &detail::submit_to<Executor>;
+			current.counter = &counter;
+
+			for (size_t ii = 0; ii < max_tokens; ++ii)
+			{
+				tokens[ii]->stage = 0;
+				ex.submit(tokens[ii]);
+			}
+
+			counter.wait();
+		}
+
+	private:
+		friend class detail::pipeline_token<T>;
+
+		typedef detail::pipeline_token<T> token;
+
+		pipeline(const pipeline&); // = delete;
+		pipeline& operator=(const pipeline&); // = delete;
+
+		// move `tok' through the stages until it is queued at a busy
+		// serial stage or retires at the exhausted input
+		void advance(token* tok)
+		{
+			while (tok)
+			{
+				detail::pipeline_stage<T>* s = stages[tok->stage];
+				if (s->mode == parallel)
+				{
+					run_stage(s, tok);
+					continue;
+				}
+
+				if (!s->enter(tok))
+					return;
+
+				// this thread owns `s': run every token queued behind
+				// `tok', sending all but the last onward via the executor
+				for (;;)
+				{
+					const bool alive = run_stage(s, tok);
+					token* queued = s->leave();
+
+					// a retiring token may be the last: once it is counted
+					// the pipeline must not be touched unless `queued'
+					// keeps the run alive
+					if (!alive)
+						current.counter->done();
+
+					if (!queued)
+					{
+						if (!alive)
+							tok = 0;
+						break;
+					}
+
+					if (alive)
+						current.submit(current.ex, tok);
+					tok = queued;
+				}
+			}
+		}
+
+		// false once the input is exhausted and `tok' retires
+		bool run_stage(detail::pipeline_stage<T>* s, token* tok)
+		{
+			if (0 == tok->stage)
+			{
+				if (exhausted || !s->process(tok->item))
+				{
+					exhausted = true;
+					return false;
+				}
+
+				tok->seq = next_input++;
+			}
+			else
+			{
+				s->process(tok->item);
+			}
+
+			if (++tok->stage == stages.size())
+				tok->stage = 0;
+			return true;
+		}
+
+		std::vector<detail::pipeline_stage<T>*> stages;
+		std::vector<token*> tokens;
+		detail::pipeline_run current;
+		bool exhausted; // owned by the input stage
+		size_t next_input;
+	};
+}
+
+#endif // MIN11__PIPELINE_H
@@ -0,0 +1,432 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__PROMISE_ARRAY_H
+#define MIN11__PROMISE_ARRAY_H
+
+#include "atomic.h"
+#include "condition_variable.h"
+#include "future.h"
+#include "mutex.h"
+
+#include <new> // placement new, operator new
+#include <stddef.h> // size_t
+
+#if MIN11_HAS_RVALREFS
+#	include <utility> // std::move
+#endif
+
+namespace min11
+{
+	template<typename T> class promise_array;
+	template<typename T> class future_array;
+
+	namespace detail
+	{
+		/**
+		 * Member of each type with the strictest fundamental alignment,
+		 * the most ::operator new guarantees for a slab
+		 */
+		union max_align
+		{
+			long double align_long_double;
+			double align_double;
+			long align_long;
+			void* align_pointer;
+			void (*align_function)();
+		};
+
+		template<typename T>
+		struct array_slot
+		{
+			enum
+			{
+				empty,
+				setting, // claimed by a setter constructing the value
+				ready
+			};
+
+			volatile long status;
+			union
+			{
+				char bytes[sizeof(T)];
+				max_align align;
+			} storage;
+
+			T* value()
+			{
+				return reinterpret_cast<T*>(storage.bytes);
+			}
+		};
+
+		/**
+		 * Shared state of a promise_array and its future_arrays: a header
+		 * followed, in the same allocation, by one slot per element and
+		 * the record of completion order.
+		 */
+		template<typename T>
+		class array_state
+		{
+		public:
+			static array_state* create(size_t count)
+			{
+				void* slab = ::operator new(slots_offset() + count * (sizeof(array_slot<T>) + sizeof(size_t)));
+				return new (slab) array_state(count);
+			}
+
+			void add_ref()
+			{
+				atomic_fetch_add(&refs, 1);
+			}
+
+			void dec_ref()
+			{
+				if (1 == atomic_fetch_add(&refs, -1))
+				{
+					this->~array_state();
+					::operator delete(this);
+				}
+			}
+
+			size_t size() const
+			{
+				return count;
+			}
+
+			bool is_ready(size_t index) const
+			{
+				return array_slot<T>::ready == atomic_load(&slots()[index].status);
+			}
+
+#if MIN11_HAS_RVALREFS
+			void set_value(size_t index, T&& value)
+			{
+				claim(index);
+#if MIN11_HAS_EXCEPTIONS
+				try
+				{
+					new (slots()[index].value()) T(std::move(value));
+				}
+				catch (...)
+				{
+					unclaim(index);
+					throw;
+				}
+#else
+				new (slots()[index].value()) T(std::move(value));
+#endif
+				publish(index);
+			}
+#endif
+			void set_value(size_t index, const T& value)
+			{
+				claim(index);
+#if MIN11_HAS_EXCEPTIONS
+				try
+				{
+					new (slots()[index].value()) T(value);
+				}
+				catch (...)
+				{
+					unclaim(index);
+					throw;
+				}
+#else
+				new (slots()[index].value()) T(value);
+#endif
+				publish(index);
+			}
+
+			const T& get(size_t index)
+			{
+				check_index(index);
+				if (!is_ready(index))
+				{
+					unique_lock<mutex> lock(mtx);
+					++waiters;
+					while (!is_ready(index))
+						cond.wait(lock);
+					--waiters;
+				}
+
+				return *slots()[index].value();
+			}
+
+			// block until `n' elements are ready
+			void wait_for_count(size_t n)
+			{
+				if (static_cast<size_t>(atomic_load(&completed)) >= n)
+					return;
+
+				unique_lock<mutex> lock(mtx);
+				++waiters;
+				while (static_cast<size_t>(completed) < n)
+					cond.wait(lock);
+				--waiters;
+			}
+
+			size_t ready_count() const
+			{
+				return static_cast<size_t>(atomic_load(&completed));
+			}
+
+			// index of the k'th element to become ready; blocks until
+			// it has
+			size_t completed_index(size_t k)
+			{
+				wait_for_count(k + 1);
+				return order()[k];
+			}
+
+		private:
+			explicit array_state(size_t count)
+				: refs(1)
+				, count(count)
+				, completed(0)
+				, waiters(0)
+			{
+				array_slot<T>* s = slots();
+				for (size_t ii = 0; ii < count; ++ii)
+					s[ii].status = array_slot<T>::empty;
+			}
+
+			~array_state()
+			{
+				array_slot<T>* s = slots();
+				for (size_t ii = 0; ii < count; ++ii)
+				{
+					if (s[ii].status == array_slot<T>::ready)
+						s[ii].value()->~T();
+				}
+			}
+
+			// the slots follow the header, as aligned as the slab itself
+			static size_t slots_offset()
+			{
+				return (sizeof(array_state) + sizeof(max_align) - 1) / sizeof(max_align) * sizeof(max_align);
+			}
+
+			array_slot<T>* slots() const
+			{
+				char* slab = reinterpret_cast<char*>(const_cast<array_state*>(this));
+				return reinterpret_cast<array_slot<T>*>(slab + slots_offset());
+			}
+
+			size_t* order() const
+			{
+				return reinterpret_cast<size_t*>(slots() + count);
+			}
+
+			void check_index(size_t index) const
+			{
+				if (index >= count)
+					detail::throw_future_error("promise_array index out of range");
+			}
+
+			// reserve an element for the calling setter: each element is
+			// set once, so `completed' never exceeds `count'
+			void claim(size_t index)
+			{
+				check_index(index);
+				if (array_slot<T>::empty != atomic_compare_exchange(&slots()[index].status, array_slot<T>::empty, array_slot<T>::setting))
+					detail::throw_future_error("future state already set");
+			}
+
+			// return an element to empty after its value failed to
+			// construct, so it may be set again
+			void unclaim(size_t index)
+			{
+				atomic_store(&slots()[index].status, array_slot<T>::empty);
+			}
+
+			void publish(size_t index)
+			{
+				unique_lock<mutex> lock(mtx);
+				order()[completed] = index;
+				atomic_store(&slots()[index].status, array_slot<T>::ready);
+				atomic_store(&completed, completed + 1);
+				if (waiters)
+					cond.notify_all();
+			}
+
+			array_state(const array_state&); // = delete;
+			array_state& operator=(const array_state&); // = delete;
+
+			volatile long refs;
+			size_t count;
+			volatile long completed;
+			unsigned waiters;
+			mutex mtx;
+			condition_variable cond;
+		};
+	}
+
+	/**
+	 * Read side of a promise_array. Copies share the same state.
+	 */
+	template<typename T>
+	class future_array
+	{
+	public:
+		future_array()
+			: state(0)
+		{
+		}
+
+		future_array(const future_array& rhs)
+			: state(rhs.state)
+		{
+			if (state)
+				state->add_ref();
+		}
+
+		~future_array()
+		{
+			if (state)
+				state->dec_ref();
+		}
+
+		future_array& operator=(const future_array& rhs)
+		{
+			if (rhs.state)
+				rhs.state->add_ref();
+			if (state)
+				state->dec_ref();
+			state = rhs.state;
+			return *this;
+		}
+
+		bool valid() const
+		{
+			return state != 0;
+		}
+
+		size_t size() const
+		{
+			return state->size();
+		}
+
+		bool is_ready(size_t index) const
+		{
+			return state->is_ready(index);
+		}
+
+		// wait for element `index' and return its value
+		const T& get(size_t index) const
+		{
+			return state->get(index);
+		}
+
+		void wait_all() const
+		{
+			state->wait_for_count(state->size());
+		}
+
+		// wait for any element; returns the index of the first to
+		// become ready
+		size_t wait_any() const
+		{
+			return state->completed_index(0);
+		}
+
+		// number of elements ready so far
+		size_t ready_count() const
+		{
+			return state->ready_count();
+		}
+
+		// index of the k'th element to become ready, waiting until it
+		// has. Visiting k = 0 .. size()-1 handles every element in
+		// completion order.
+		size_t completed_index(size_t k) const
+		{
+			return state->completed_index(k);
+		}
+
+	private:
+		friend class promise_array<T>;
+
+		explicit future_array(detail::array_state<T>* state)
+			: state(state)
+		{
+			state->add_ref();
+		}
+
+		detail::array_state<T>* state;
+	};
+
+	/**
+	 * `count' promises sharing a single allocation, reference count,
+	 * mutex and condition variable, for scatter/gather over many
+	 * results. Each element may be set once; setting it again, or an
+	 * index past the end, throws future_error. If copying or moving the
+	 * value in throws, the exception propagates and the element stays
+	 * unset.
+	 */
+	template<typename T>
+	class promise_array
+	{
+	public:
+		explicit promise_array(size_t count)
+			: state(detail::array_state<T>::create(count))
+		{
+		}
+
+		~promise_array()
+		{
+			state->dec_ref();
+		}
+
+		size_t size() const
+		{
+			return state->size();
+		}
+
+#if MIN11_HAS_RVALREFS
+		void set_value(size_t index, T&& value)
+		{
+			state->set_value(index, std::move(value));
+		}
+#endif
+		void set_value(size_t index, const T& value)
+		{
+			state->set_value(index, value);
+		}
+
+		future_array<T> get_futures()
+		{
+			return future_array<T>(state);
+		}
+
+	private:
+		promise_array(const promise_array&); // = delete;
+		promise_array& operator=(const promise_array&); // = delete;
+
+		detail::array_state<T>* state;
+	};
+}
+
+#endif // MIN11__PROMISE_ARRAY_H
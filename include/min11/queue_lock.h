@@ -0,0 +1,214 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__QUEUE_LOCK_H
+#define MIN11__QUEUE_LOCK_H
+
+#include "atomic.h"
+#include "config.h"
+#include "thread.h"
+
+namespace min11
+{
+	namespace detail
+	{
+		/**
+		 * Queue entry of a thread waiting for, or holding, an mcs_lock.
+		 * Each entry sits on its own cache line so a waiter's spinning
+		 * touches no other thread's line.
+		 */
+		struct mcs_node
+		{
+			mcs_node* volatile next;
+			volatile long locked;
+			mcs_node* free_next;
+			char pad[MIN11_CACHE_LINE_SIZE];
+		};
+
+		// per-thread cache of queue entries, released at thread exit
+		mcs_node* acquire_mcs_node();
+		void release_mcs_node(mcs_node* node);
+
+		enum
+		{
+			// spins before a waiter starts yielding its time slice
+			queue_lock_spin_limit = 1 << 10
+		};
+	}
+
+	/**
+	 * FIFO spin lock: each locker takes a ticket and waits for it to be
+	 * served. All waiters read the same counter, so a release costs one
+	 * cache line transfer per waiter; prefer mcs_lock when many threads
+	 * contend. Waiters back off in proportion to their place in line.
+	 */
+	class ticket_lock
+	{
+	public:
+		ticket_lock()
+			: next(0)
+			, serving(0)
+		{
+		}
+
+		void lock()
+		{
+			const long ticket = detail::atomic_fetch_add(&next, 1);
+			unsigned spins = 0;
+			for (;;)
+			{
+				const long ahead = ticket - detail::atomic_load(&serving);
+				if (!ahead)
+					return;
+
+				if (spins < detail::queue_lock_spin_limit)
+				{
+					for (long ii = 0; ii < ahead; ++ii)
+						detail::cpu_relax();
+					spins += static_cast<unsigned>(ahead);
+				}
+				else
+				{
+					detail::yield_thread();
+				}
+			}
+		}
+
+		bool try_lock()
+		{
+			const long current = detail::atomic_load(&serving);
+			return current == detail::atomic_compare_exchange(&next, current, current + 1);
+		}
+
+		void unlock()
+		{
+			// only the holder writes `serving'
+			detail::atomic_store(&serving, serving + 1);
+		}
+
+	private:
+		ticket_lock(const ticket_lock&); // = delete;
+		ticket_lock& operator=(const ticket_lock&); // = delete;
+
+		volatile long next;
+		char next_pad[MIN11_CACHE_LINE_SIZE - sizeof(long)];
+		volatile long serving;
+		char serving_pad[MIN11_CACHE_LINE_SIZE - sizeof(long)];
+	};
+
+	/**
+	 * Mellor-Crummey & Scott queue lock. Waiters form a linked queue
+	 * and each spins on a flag in its own entry, which its predecessor
+	 * clears on release: FIFO handoff with a constant number of cache
+	 * line transfers per acquisition, however many threads wait.
+	 *
+	 * Queue entries come from a per-thread cache, so the lock works
+	 * with unique_lock and a thread may hold several mcs_locks at once.
+	 */
+	class mcs_lock
+	{
+	public:
+		mcs_lock()
+			: tail(0)
+			, holder(0)
+		{
+		}
+
+		void lock()
+		{
+			detail::mcs_node* node = detail::acquire_mcs_node();
+			node->next = 0;
+			node->locked = 1;
+
+			detail::mcs_node* predecessor = detail::atomic_exchange(&tail, node);
+			if (predecessor)
+			{
+				detail::atomic_store(&predecessor->next, node);
+
+				unsigned spins = 0;
+				while (detail::atomic_load(&node->locked))
+				{
+					if (++spins < detail::queue_lock_spin_limit)
+						detail::cpu_relax();
+					else
+						detail::yield_thread();
+				}
+			}
+
+			holder = node;
+		}
+
+		bool try_lock()
+		{
+			detail::mcs_node* node = detail::acquire_mcs_node();
+			node->next = 0;
+			node->locked = 1;
+
+			if (0 != detail::atomic_compare_exchange(&tail, static_cast<detail::mcs_node*>(0), node))
+			{
+				detail::release_mcs_node(node);
+				return false;
+			}
+
+			holder = node;
+			return true;
+		}
+
+		void unlock()
+		{
+			detail::mcs_node* node = holder;
+			detail::mcs_node* successor = detail::atomic_load(&node->next);
+			if (!successor)
+			{
+				// no known successor: leave the queue empty, unless a
+				// locker is between swapping `tail' and linking in
+				if (node == detail::atomic_compare_exchange(&tail, node, static_cast<detail::mcs_node*>(0)))
+				{
+					detail::release_mcs_node(node);
+					return;
+				}
+
+				while (!(successor = detail::atomic_load(&node->next)))
+					detail::cpu_relax();
+			}
+
+			detail::atomic_store(&successor->locked, 0);
+			detail::release_mcs_node(node);
+		}
+
+	private:
+		mcs_lock(const mcs_lock&); // = delete;
+		mcs_lock& operator=(const mcs_lock&); // = delete;
+
+		detail::mcs_node* volatile tail;
+
+		// written only by the thread holding the lock
+		detail::mcs_node* holder;
+		char pad[MIN11_CACHE_LINE_SIZE];
+	};
+}
+
+#endif // MIN11__QUEUE_LOCK_H
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__SEQLOCK_H
+#define MIN11__SEQLOCK_H
+
+#include "atomic.h"
+
+#include <stddef.h> // size_t
+#include <string.h> // memcpy
+
+namespace min11
+{
+	/**
+	 * Sequence lock guarding a small trivially copyable value.
+	 *
+	 * A writer makes the sequence number odd, copies the value in and
+	 * makes it even again. Readers copy the value out between two reads
+	 * of the sequence number and retry if a write overlapped, so reading
+	 * never writes shared memory and readers do not contend with each
+	 * other. Writers are serialized with each other; a steady stream of
+	 * writes can starve readers.
+	 *
+	 * T must be trivially copyable: it is copied with memcpy, and a
+	 * reader may observe (and discard) a partially written copy.
+	 */
+	template<typename T>
+	class seqlock
+	{
+	public:
+		seqlock()
+			: seq(0)
+		{
+			const T value = T();
+			store_words(value);
+		}
+
+		explicit seqlock(const T& value)
+			: seq(0)
+		{
+			store_words(value);
+		}
+
+		T load() const
+		{
+			T value;
+			load(value);
+			return value;
+		}
+
+		void load(T& value) const
+		{
+			while (!try_load(value))
+				detail::cpu_relax();
+		}
+
+		// a single read attempt; returns false, leaving `value' in an
+		// unspecified state, if a write was in progress
+		bool try_load(T& value) const
+		{
+			const long before = detail::atomic_load_acquire(&seq);
+			if (before & 1)
+				return false;
+
+			long copy[word_count];
+			for (size_t ii = 0; ii < word_count; ++ii)
+				copy[ii] = detail::atomic_load_relaxed(&words[ii]);
+
+			// order the copy before the second sequence read
+			detail::atomic_fence_acquire();
+			if (detail::atomic_load_relaxed(&seq) != before)
+				return false;
+
+			memcpy(&value, copy, sizeof(T));
+			return true;
+		}
+
+		void store(const T& value)
+		{
+			long current = detail::atomic_load(&seq);
+			for (;;)
+			{
+				if (!(current & 1))
+				{
+					const long previous = detail::atomic_compare_exchange(&seq, current, current + 1);
+					if (previous == current)
+						break;
+					current = previous;
+				}
+				else
+				{
+					detail::cpu_relax();
+					current = detail::atomic_load(&seq);
+				}
+			}
+
+			store_words(value);
+			detail::atomic_store(&seq, current + 2);
+		}
+
+	private:
+		seqlock(const seqlock&); // = delete;
+		seqlock& operator=(const seqlock&); // = delete;
+
+		enum
+		{
+			word_count = (sizeof(T) + sizeof(long) - 1) / sizeof(long)
+		};
+
+		void store_words(const T& value)
+		{
+			long copy[word_count];
+			copy[word_count - 1] = 0;
+			memcpy(copy, &value, sizeof(T));
+			for (size_t ii = 0; ii < word_count; ++ii)
+				detail::atomic_store_relaxed(&words[ii], copy[ii]);
+		}
+
+		volatile long seq;
+		volatile long words[word_count];
+	};
+}
+
+#endif // MIN11__SEQLOCK_H
@@ -0,0 +1,378 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__STOP_TOKEN_H
+#define MIN11__STOP_TOKEN_H
+
+#include "atomic.h"
+#include "atomic_counter.h"
+#include "thread.h"
+
+namespace min11
+{
+	namespace detail
+	{
+		class stop_callback_base
+		{
+		public:
+			void invoke()
+			{
+				fn(this);
+			}
+
+		protected:
+			explicit stop_callback_base(void (*fn)(stop_callback_base*))
+				: fn(fn)
+			{
+			}
+
+		private:
+			void (*fn)(stop_callback_base*);
+		};
+
+		/**
+		 * Registration slot for a stop callback. Slots belong to their
+		 * stop_state and are recycled once their callback deregisters,
+		 * so neither registration nor deregistration takes a lock.
+		 */
+		struct stop_slot
+		{
+			enum
+			{
+				unused,
+				claimed,
+				armed,
+				running,
+				detached, // deregistered by its own running callback
+				done
+			};
+
+			stop_slot* next;
+			stop_callback_base* callback;
+			volatile long invoker;
+			volatile long state;
+		};
+
+		/**
+		 * State shared by a stop_source and its tokens and callbacks
+		 */
+		class stop_state
+		{
+		public:
+			stop_state()
+				: refcnt(1)
+				, stopped(0)
+				, slots(0)
+			{
+			}
+
+			~stop_state()
+			{
+				stop_slot* slot = slots;
+				while (slot)
+				{
+					stop_slot* next = slot->next;
+					delete slot;
+					slot = next;
+				}
+			}
+
+			void add_ref()
+			{
+				refcnt.incr();
+			}
+
+			void dec_ref()
+			{
+				if (0 == refcnt.decr())
+				{
+					delete this;
+				}
+			}
+
+			bool stop_requested() const
+			{
+				return 0 != atomic_load(&stopped);
+			}
+
+			// returns false if stop was already requested
+			bool request_stop()
+			{
+				if (0 != atomic_exchange(&stopped, 1))
+					return false;
+
+				for (stop_slot* slot = atomic_load(&slots); slot; slot = slot->next)
+					try_invoke(slot);
+
+				return true;
+			}
+
+			// register `cb'. Returns 0 if stop was already requested, in
+			// which case `cb' has been invoked on the calling thread.
+			stop_slot* attach(stop_callback_base* cb)
+			{
+				if (stop_requested())
+				{
+					cb->invoke();
+					return 0;
+				}
+
+				stop_slot* slot = atomic_load(&slots);
+				while (slot && stop_slot::unused != atomic_compare_exchange(&slot->state, stop_slot::unused, stop_slot::claimed))
+					slot = slot->next;
+
+				if (!slot)
+				{
+					slot = new stop_slot;
+					slot->state = stop_slot::claimed;
+					for (;;)
+					{
+						stop_slot* head = atomic_load(&slots);
+						slot->next = head;
+						if (head == atomic_compare_exchange(&slots, head, slot))
+							break;
+					}
+				}
+
+				slot->callback = cb;
+				slot->invoker = 0;
+				atomic_store(&slot->state, stop_slot::armed);
+
+				// request_stop may have walked past the slot before it
+				// was armed
+				if (stop_requested())
+					try_invoke(slot);
+
+				return slot;
+			}
+
+			// deregister a callback. If the callback is running on another
+			// thread, wait for it to finish.
+			void detach(stop_slot* slot)
+			{
+				if (!slot)
+					return;
+
+				if (stop_slot::armed == atomic_compare_exchange(&slot->state, stop_slot::armed, stop_slot::unused))
+					return;
+
+				const long self = static_cast<long>(current_thread_id());
+				while (stop_slot::running == atomic_load(&slot->state))
+				{
+					// deregistering from within the callback itself; the
+					// invoking thread releases the slot once it returns
+					if (self == atomic_load(&slot->invoker))
+					{
+						atomic_store(&slot->state, stop_slot::detached);
+						return;
+					}
+
+					cpu_relax();
+				}
+
+				atomic_store(&slot->state, stop_slot::unused);
+			}
+
+		private:
+			stop_state(const stop_state&); // = delete;
+			stop_state& operator=(const stop_state&); // = delete;
+
+			static void try_invoke(stop_slot* slot)
+			{
+				if (stop_slot::armed != atomic_compare_exchange(&slot->state, stop_slot::armed, stop_slot::running))
+					return;
+
+				atomic_store(&slot->invoker, static_cast<long>(current_thread_id()));
+				slot->callback->invoke();
+
+				// a callback that deregistered itself is gone: nobody else
+				// will release its slot
+				if (stop_slot::running != atomic_compare_exchange(&slot->state, stop_slot::running, stop_slot::done))
+					atomic_store(&slot->state, stop_slot::unused);
+			}
+
+			detail::atomic_counter refcnt;
+			volatile long stopped;
+			stop_slot* volatile slots;
+		};
+	}
+
+	template<typename Callback> class stop_callback;
+
+	/**
+	 * Minimal emulation for std::stop_token
+	 */
+	class stop_token
+	{
+		friend class stop_source;
+		template<typename Callback> friend class stop_callback;
+	public:
+		stop_token()
+			: state(0)
+		{
+		}
+
+		// observe an existing stop state
+		explicit stop_token(detail::stop_state* s)
+			: state(s)
+		{
+			if (state)
+				state->add_ref();
+		}
+
+		stop_token(const stop_token& other)
+			: state(other.state)
+		{
+			if (state)
+				state->add_ref();
+		}
+
+		~stop_token()
+		{
+			if (state)
+				state->dec_ref();
+		}
+
+		stop_token& operator=(const stop_token& rhs)
+		{
+			if (rhs.state)
+				rhs.state->add_ref();
+			if (state)
+				state->dec_ref();
+			state = rhs.state;
+			return *this;
+		}
+
+		bool stop_requested() const
+		{
+			return state && state->stop_requested();
+		}
+
+		bool stop_possible() const
+		{
+			return state != 0;
+		}
+
+	private:
+		detail::stop_state* state;
+	};
+
+	/**
+	 * Minimal emulation for std::stop_source
+	 */
+	class stop_source
+	{
+	public:
+		stop_source()
+			: state(new detail::stop_state)
+		{
+		}
+
+		stop_source(const stop_source& other)
+			: state(other.state)
+		{
+			state->add_ref();
+		}
+
+		~stop_source()
+		{
+			state->dec_ref();
+		}
+
+		stop_source& operator=(const stop_source& rhs)
+		{
+			rhs.state->add_ref();
+			state->dec_ref();
+			state = rhs.state;
+			return *this;
+		}
+
+		stop_token get_token() const
+		{
+			return stop_token(state);
+		}
+
+		bool stop_requested() const
+		{
+			return state->stop_requested();
+		}
+
+		bool request_stop()
+		{
+			return state->request_stop();
+		}
+
+	private:
+		detail::stop_state* state;
+	};
+
+	/**
+	 * Minimal emulation for std::stop_callback. The callback runs on the
+	 * thread requesting stop, or immediately in the constructor if stop
+	 * was already requested.
+	 */
+	template<typename Callback>
+	class stop_callback : private detail::stop_callback_base
+	{
+	public:
+		stop_callback(const stop_token& token, const Callback& cb)
+			: detail::stop_callback_base(&stop_callback::invoke_callback)
+			, cb(cb)
+			, state(token.state)
+			, slot(0)
+		{
+			if (state)
+			{
+				state->add_ref();
+				slot = state->attach(this);
+			}
+		}
+
+		~stop_callback()
+		{
+			if (state)
+			{
+				state->detach(slot);
+				state->dec_ref();
+			}
+		}
+
+	private:
+		stop_callback(const stop_callback&); // = delete;
+		stop_callback& operator=(const stop_callback&); // = delete;
+
+		static void invoke_callback(detail::stop_callback_base* base)
+		{
+			static_cast<stop_callback*>(base)->cb();
+		}
+
+		Callback cb;
+		detail::stop_state* state;
+		detail::stop_slot* slot;
+	};
+}
+
+#endif // MIN11__STOP_TOKEN_H
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__STRAND_H
+#define MIN11__STRAND_H
+
+#include "config.h"
+#include "atomic.h"
+#include "executor.h"
+#include "thread.h"
+
+#if MIN11_HAS_RVALREFS
+#	include <utility> // std::forward
+#endif
+
+namespace min11
+{
+	namespace detail
+	{
+		/**
+		 * Placeholder node keeping a strand's queue non-empty
+		 */
+		class strand_stub : public task
+		{
+		public:
+			virtual void run()
+			{
+			}
+		};
+	}
+
+	/**
+	 * Executor adaptor running the tasks submitted to it one at a time,
+	 * in submission order, on an underlying executor. Objects touched
+	 * only from a strand's tasks need no lock, and a thread finding the
+	 * strand busy queues its work and moves on instead of blocking.
+	 *
+	 * Tasks are queued on an intrusive multi-producer, single-consumer
+	 * list (Vyukov's algorithm), and a count of pending tasks decides
+	 * which submitter hands the strand to `ex': submitting never takes
+	 * a lock. The strand runs at most `batch' tasks before resubmitting
+	 * itself, so one busy strand cannot monopolize a worker. The strand
+	 * must be idle when destroyed; `ex' must outlive it.
+	 */
+	template<typename Executor>
+	class strand
+	{
+	public:
+		explicit strand(Executor& ex, unsigned batch = 64)
+			: ex(&ex)
+			, batch(batch ? batch : 1)
+			, head(&stub)
+			, tail(&stub)
+			, pending(0)
+			, runner(this)
+		{
+		}
+
+		void submit(detail::task* t)
+		{
+			push(t);
+
+			// the submitter taking the strand from idle schedules it
+			if (0 == detail::atomic_fetch_add(&pending, 1))
+				ex->submit(&runner);
+		}
+
+#if MIN11_HAS_RVALREFS
+		template<typename Func>
+		void post(Func&& f)
+		{
+			submit(detail::make_task(std::forward<Func>(f)));
+		}
+#else
+		template<typename Func>
+		void post(const Func& f)
+		{
+			submit(detail::make_task(f));
+		}
+#endif
+
+		/**
+		 * True when no task is queued or running. Once observed, the
+		 * strand may be destroyed unless more work is submitted.
+		 */
+		bool idle() const
+		{
+			return 0 == detail::atomic_load(&pending);
+		}
+
+		Executor& executor() const
+		{
+			return *ex;
+		}
+
+	private:
+		strand(const strand&); // = delete;
+		strand& operator=(const strand&); // = delete;
+
+		/**
+		 * Task draining the strand on the underlying executor. Never
+		 * deleted; at most one submission is outstanding.
+		 */
+		class runner_task : public detail::task
+		{
+		public:
+			explicit runner_task(strand* owner)
+				: owner(owner)
+			{
+			}
+
+			virtual void run()
+			{
+				strand* s = owner;
+				for (unsigned ran = 0; ; )
+				{
+					detail::task* t = s->pop();
+					t->run();
+
+					// once the count drops to zero another submitter may
+					// reschedule the strand: `s' is not touched again
+					if (1 == detail::atomic_fetch_add(&s->pending, -1))
+						return;
+
+					if (++ran == s->batch)
+					{
+						s->ex->submit(this);
+						return;
+					}
+				}
+			}
+
+		private:
+			strand* owner;
+		};
+
+		// producers link at `head'
+		void push(detail::task* t)
+		{
+			t->next = 0;
+			detail::task* prev = detail::atomic_exchange(&head, t);
+			detail::atomic_store(&prev->next, t);
+		}
+
+		// Only called by the runner, with at least one task pending. A
+		// producer between swapping `head' and linking its task leaves
+		// the list briefly cut; wait for the link.
+		detail::task* pop()
+		{
+			for (int spins = 0; ; ++spins)
+			{
+				if (detail::task* t = try_pop())
+					return t;
+
+				if (spins < 64)
+					detail::cpu_relax();
+				else
+					detail::yield_thread();
+			}
+		}
+
+		detail::task* try_pop()
+		{
+			detail::task* t = tail;
+			detail::task* next = detail::atomic_load(&t->next);
+			if (t == &stub)
+			{
+				if (!next)
+					return 0;
+
+				tail = next;
+				t = next;
+				next = detail::atomic_load(&next->next);
+			}
+
+			if (next)
+			{
+				tail = next;
+				return t;
+			}
+
+			if (t != detail::atomic_load(&head))
+				return 0;
+
+			// `t' is the last task: requeue the stub behind it so it can
+			// be detached
+			push(&stub);
+			next = detail::atomic_load(&t->next);
+			if (next)
+			{
+				tail = next;
+				return t;
+			}
+
+			return 0;
+		}
+
+		Executor* ex;
+		unsigned batch;
+		detail::task* volatile head;
+		char head_pad[MIN11_CACHE_LINE_SIZE];
+		detail::task* tail; // owned by the running task
+		volatile long pending;
+		detail::strand_stub stub;
+		runner_task runner;
+	};
+}
+
+#endif // MIN11__STRAND_H
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__TASK_H
+#define MIN11__TASK_H
+
+#include "config.h"
+#include "future.h"
+
+#if MIN11_HAS_COROUTINES
+
+#include <coroutine>
+#include <exception> // std::current_exception, std::terminate
+#include <utility> // std::move
+
+namespace min11
+{
+	template<typename T> class task;
+
+	namespace detail
+	{
+		/**
+		 * Coroutine promise of task<T>; completes a min11::promise<T>
+		 * with the coroutine's result.
+		 */
+		template<typename T>
+		class task_promise_base
+		{
+		public:
+			std::suspend_never initial_suspend() noexcept
+			{
+				return std::suspend_never();
+			}
+
+			std::suspend_never final_suspend() noexcept
+			{
+				return std::suspend_never();
+			}
+
+			// rethrown from the task's get()
+			void unhandled_exception()
+			{
+#if MIN11_HAS_EXCEPTION_PTR
+				result.set_exception(std::current_exception());
+#else
+				std::terminate();
+#endif
+			}
+
+		protected:
+			min11::promise<T> result;
+		};
+
+		template<typename T>
+		class task_promise : public task_promise_base<T>
+		{
+		public:
+			min11::task<T> get_return_object()
+			{
+				return min11::task<T>(this->result.get_future());
+			}
+
+			void return_value(T value)
+			{
+				this->result.set_value(std::move(value));
+			}
+		};
+
+		template<>
+		class task_promise<void> : public task_promise_base<void>
+		{
+		public:
+			inline min11::task<void> get_return_object();
+
+			void return_void()
+			{
+				this->result.set_value();
+			}
+		};
+	}
+
+	/**
+	 * Eagerly started coroutine producing a T. The coroutine runs on the
+	 * calling thread until its first suspension, then on whichever thread
+	 * resumes it. The result is observed by co_await on the task, or by
+	 * blocking in get()/wait().
+	 */
+	template<typename T>
+	class task
+	{
+		friend class detail::task_promise<T>;
+	public:
+		typedef detail::task_promise<T> promise_type;
+
+		task()
+		{
+		}
+
+		task(task<T>&& rhs)
+			: result(std::move(rhs.result))
+		{
+		}
+
+		task& operator=(task<T>&& rhs)
+		{
+			result = std::move(rhs.result);
+			return *this;
+		}
+
+		bool valid() const
+		{
+			return result.valid();
+		}
+
+		void wait() const
+		{
+			result.wait();
+		}
+
+		T get()
+		{
+			return result.get();
+		}
+
+		shared_future<T> share()
+		{
+			return result.share();
+		}
+
+		detail::future_awaiter<future<T> > operator co_await()
+		{
+			return result.operator co_await();
+		}
+
+	private:
+		task(const task&); // = delete;
+		task& operator=(const task&); // = delete;
+
+		explicit task(future<T>&& f)
+			: result(std::move(f))
+		{
+		}
+
+		future<T> result;
+	};
+
+	inline task<void> detail::task_promise<void>::get_return_object()
+	{
+		return min11::task<void>(this->result.get_future());
+	}
+}
+
+#endif // MIN11_HAS_COROUTINES
+
+#endif // MIN11__TASK_H
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__TASK_GRAPH_H
+#define MIN11__TASK_GRAPH_H
+
+#include "atomic.h"
+#include "executor.h"
+#include "parallel.h"
+
+#include <stddef.h> // size_t
+
+#if MIN11_HAS_EXCEPTIONS
+#	include <stdexcept>
+#endif
+
+namespace min11
+{
+	class task_graph;
+
+	namespace detail
+	{
+		// executor and completion counter of the run in progress
+		struct graph_run
+		{
+			void* ex;
+			void (*submit)(void* ex, task* t);
+			completion_counter* counter;
+		};
+
+		/**
+		 * Node of a task_graph. Unlike other tasks, nodes are owned by
+		 * their graph and survive being run so the graph can run again.
+		 */
+		class graph_node : public task
+		{
+		public:
+			explicit graph_node(graph_run* current)
+				: current(current)
+				, successors(0)
+				, nsuccessors(0)
+				, capacity(0)
+				, dependencies(0)
+				, pending(0)
+			{
+			}
+
+			virtual ~graph_node()
+			{
+				delete[] successors;
+			}
+
+			virtual void run()
+			{
+				graph_node* node = this;
+				while (node)
+				{
+					node->invoke();
+
+					// submit every successor this node released except
+					// the last, which this thread runs next
+					graph_node* next = 0;
+					for (size_t ii = 0; ii < node->nsuccessors; ++ii)
+					{
+						graph_node* successor = node->successors[ii];
+						if (1 != atomic_fetch_add(&successor->pending, -1))
+							continue;
+
+						if (next)
+							current->submit(current->ex, next);
+						next = successor;
+					}
+
+					current->counter->done();
+					node = next;
+				}
+			}
+
+		private:
+			friend class min11::task_graph;
+
+			virtual void invoke() = 0;
+
+			void add_successor(graph_node* node)
+			{
+				if (nsuccessors == capacity)
+				{
+					capacity = capacity ? capacity * 2 : 4;
+					graph_node** grown = new graph_node*[capacity];
+					for (size_t ii = 0; ii < nsuccessors; ++ii)
+						grown[ii] = successors[ii];
+					delete[] successors;
+					successors = grown;
+				}
+
+				successors[nsuccessors++] = node;
+				++node->dependencies;
+			}
+
+			graph_run* current;
+			graph_node** successors;
+			size_t nsuccessors;
+			size_t capacity;
+			long dependencies;
+			volatile long pending;
+		};
+
+		template<typename Func>
+		class graph_function_node : public graph_node
+		{
+		public:
+			graph_function_node(graph_run* current, const Func& f)
+				: graph_node(current)
+				, f(f)
+			{
+			}
+
+		private:
+			virtual void invoke()
+			{
+				f();
+			}
+
+			Func f;
+		};
+	}
+
+	/**
+	 * Directed acyclic graph of function objects. A node is submitted to
+	 * the executor once every node it depends on has finished, tracked by
+	 * an atomic count of unfinished dependencies; no thread blocks
+	 * waiting for inputs. The graph is built once and may then be run any
+	 * number of times without allocating: nodes, roots and the counter
+	 * awaited by run() are all kept between runs.
+	 *
+	 * A graph must not be modified or run again while a run is in
+	 * progress. Function objects must not throw.
+	 */
+	class task_graph
+	{
+	public:
+		typedef detail::graph_node* node;
+
+		task_graph()
+			: counter(0)
+			, nodes(0)
+			, nnodes(0)
+			, capacity(0)
+			, roots(0)
+			, nroots(0)
+			, validated(false)
+		{
+			current.ex = 0;
+			current.submit = 0;
+			current.counter = &counter;
+		}
+
+		~task_graph()
+		{
+			for (size_t ii = 0; ii < nnodes; ++ii)
+				delete nodes[ii];
+			delete[] nodes;
+			delete[] roots;
+		}
+
+		// add a node running `f'
+		template<typename Func>
+		node add(const Func& f)
+		{
+			if (nnodes == capacity)
+			{
+				capacity = capacity ? capacity * 2 : 16;
+				detail::graph_node** grown = new detail::graph_node*[capacity];
+				for (size_t ii = 0; ii < nnodes; ++ii)
+					grown[ii] = nodes[ii];
+				delete[] nodes;
+				nodes = grown;
+			}
+
+			detail::graph_node* n = new detail::graph_function_node<Func>(&current, f);
+			nodes[nnodes++] = n;
+			validated = false;
+			return n;
+		}
+
+		// `after' runs only once `before' has finished
+		void precede(node before, node after)
+		{
+			before->add_successor(after);
+			validated = false;
+		}
+
+		size_t size() const
+		{
+			return nnodes;
+		}
+
+		// run every node on `ex' and wait for the graph to finish
+		template<typename Executor>
+		void run(Executor& ex)
+		{
+			if (!nnodes)
+				return;
+
+			if (!validated)
+				validate();
+
+			counter.reset(static_cast<long>(nnodes));
+			current.ex = &ex;
+			current.submit = &detail::submit_to<Executor>;
+
+			for (size_t ii = 0; ii < nnodes; ++ii)
+				nodes[ii]->pending = nodes[ii]->dependencies;
+
+			for (size_t ii = 0; ii < nroots; ++ii)
+				ex.submit(roots[ii]);
+
+			counter.wait();
+		}
+
+	private:
+		task_graph(const task_graph&); // = delete;
+		task_graph& operator=(const task_graph&); // = delete;
+
+		// collect the roots and reject cycles (Kahn's algorithm), once
+		// per change to the graph
+		void validate()
+		{
+			delete[] roots;
+			roots = new detail::graph_node*[nnodes];
+			nroots = 0;
+
+			detail::graph_node** order = new detail::graph_node*[nnodes];
+			size_t head = 0;
+			size_t tail = 0;
+			for (size_t ii = 0; ii < nnodes; ++ii)
+			{
+				nodes[ii]->pending = nodes[ii]->dependencies;
+				if (!nodes[ii]->dependencies)
+				{
+					roots[nroots++] = nodes[ii];
+					order[tail++] = nodes[ii];
+				}
+			}
+
+			while (head != tail)
+			{
+				detail::graph_node* n = order[head++];
+				for (size_t ii = 0; ii < n->nsuccessors; ++ii)
+				{
+					detail::graph_node* successor = n->successors[ii];
+					successor->pending = successor->pending - 1;
+					if (!successor->pending)
+						order[tail++] = successor;
+				}
+			}
+
+			delete[] order;
+			if (tail != nnodes)
+			{
+#if MIN11_HAS_EXCEPTIONS
+				throw std::logic_error("task_graph contains a cycle");
+#else
+				MIN11_THROW_EXCEPTION("task_graph contains a cycle");
+#endif
+			}
+
+			validated = true;
+		}
+
+		detail::graph_run current;
+		detail::completion_counter counter;
+		detail::graph_node** nodes;
+		size_t nnodes;
+		size_t capacity;
+		detail::graph_node** roots;
+		size_t nroots;
+		bool validated;
+	};
+}
+
+#endif // MIN11__TASK_GRAPH_H
@@ -0,0 +1,398 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__THREAD_H
+#define MIN11__THREAD_H
+
+#include "config.h"
+
+#include <exception> // std::terminate
+#include <stddef.h> // size_t
+
+#if MIN11_HAS_EXCEPTIONS
+#	include <stdexcept>
+#endif
+
+#if MIN11_HAS_RVALREFS
+#	include <type_traits> // std::decay
+#	include <utility> // std::forward
+#endif
+
+namespace min11
+{
+	/**
+	 * Attributes applied to a thread as it is created
+	 */
+	class thread_attributes
+	{
+	public:
+		enum scheduling_policy
+		{
+			sched_default,
+			sched_fifo,
+			sched_round_robin,
+			sched_batch,
+			sched_idle
+		};
+
+		enum
+		{
+			max_cpus = 1024,
+			word_bits = sizeof(unsigned long) * 8,
+			cpu_words = max_cpus / word_bits
+		};
+
+		thread_attributes()
+			: stack(0)
+			, policy(sched_default)
+			, priority(0)
+		{
+			clear_affinity();
+			thread_name[0] = '\0';
+		}
+
+		// reserve `bytes' of stack; 0 selects the platform default
+		thread_attributes& set_stack_size(size_t bytes)
+		{
+			stack = bytes;
+			return *this;
+		}
+
+		// allow the thread to run on `cpu'. A thread with no cpus set
+		// may run anywhere.
+		thread_attributes& add_cpu(unsigned cpu)
+		{
+			if (cpu < max_cpus)
+				cpus[cpu / word_bits] |= 1ul << (cpu % word_bits);
+			return *this;
+		}
+
+		thread_attributes& clear_affinity()
+		{
+			for (unsigned ii = 0; ii < cpu_words; ++ii)
+				cpus[ii] = 0;
+			return *this;
+		}
+
+		// real-time policies need the privilege to use them; thread
+		// creation fails without it
+		thread_attributes& set_scheduling(scheduling_policy p, int prio = 0)
+		{
+			policy = p;
+			priority = prio;
+			return *this;
+		}
+
+		// name shown by debuggers and tools such as top and perf.
+		// Platforms may truncate it (Linux keeps 15 characters).
+		thread_attributes& set_name(const char* name)
+		{
+			size_t ii = 0;
+			for (; name[ii] && ii < sizeof(thread_name) - 1; ++ii)
+				thread_name[ii] = name[ii];
+			thread_name[ii] = '\0';
+			return *this;
+		}
+
+		size_t stack_size() const
+		{
+			return stack;
+		}
+
+		bool has_affinity() const
+		{
+			for (unsigned ii = 0; ii < cpu_words; ++ii)
+				if (cpus[ii])
+					return true;
+			return false;
+		}
+
+		bool has_cpu(unsigned cpu) const
+		{
+			return cpu < max_cpus && 0 != (cpus[cpu / word_bits] & (1ul << (cpu % word_bits)));
+		}
+
+		scheduling_policy scheduling() const
+		{
+			return policy;
+		}
+
+		int scheduling_priority() const
+		{
+			return priority;
+		}
+
+		const char* name() const
+		{
+			return thread_name;
+		}
+
+	private:
+		size_t stack;
+		unsigned long cpus[cpu_words];
+		scheduling_policy policy;
+		int priority;
+		char thread_name[64];
+	};
+
+	/**
+	 * Thrown when a thread cannot be created
+	 */
+#if MIN11_HAS_EXCEPTIONS
+	struct thread_error
+		: public std::runtime_error
+	{
+		thread_error(const char* message)
+			: std::runtime_error(message)
+		{
+		}
+	};
+#endif
+
+	namespace detail
+	{
+		struct thread_internal;
+
+		// start a native thread running entry(arg). Returns 0 if the
+		// thread could not be created.
+		thread_internal* create_thread(void (*entry)(void*), void* arg, const thread_attributes* attr = 0);
+
+		// wait for a thread started by create_thread, then release it
+		void join_thread(thread_internal* t);
+
+		// let a thread started by create_thread run to completion
+		// unobserved, then release it
+		void detach_thread(thread_internal* t);
+
+		// identifier of a thread started by create_thread
+		unsigned long thread_id(const thread_internal* t);
+
+		// number of hardware threads available to the process
+		unsigned hardware_concurrency();
+
+		// identifier of the calling thread, unique among running threads
+		unsigned long current_thread_id();
+
+		// offer the remainder of the calling thread's time slice
+		void yield_thread();
+
+		// milliseconds since an arbitrary fixed point; never goes
+		// backwards
+		unsigned long long monotonic_milliseconds();
+
+		// suspend the calling thread for at least `ms' milliseconds
+		void sleep_milliseconds(unsigned long ms);
+
+		static inline void throw_thread_error(const char* message)
+		{
+#if MIN11_HAS_EXCEPTIONS
+			throw thread_error(message);
+#else
+			MIN11_THROW_EXCEPTION(message);
+#endif
+		}
+
+		class thread_start
+		{
+		public:
+			virtual ~thread_start()
+			{
+			}
+
+			virtual void run() = 0;
+
+			static void entry(void* arg)
+			{
+				thread_start* start = static_cast<thread_start*>(arg);
+				start->run();
+				delete start;
+			}
+		};
+
+		template<typename Func>
+		class thread_start_function : public thread_start
+		{
+		public:
+			explicit thread_start_function(const Func& f)
+				: f(f)
+			{
+			}
+
+#if MIN11_HAS_RVALREFS
+			explicit thread_start_function(Func&& f)
+				: f(std::move(f))
+			{
+			}
+#endif
+
+			virtual void run()
+			{
+				f();
+			}
+
+		private:
+			Func f;
+		};
+	}
+
+	/**
+	 * Minimal emulation for std::thread, optionally created with
+	 * thread_attributes
+	 */
+	class thread
+	{
+	public:
+		typedef unsigned long id;
+
+		thread()
+			: t(0)
+		{
+		}
+
+#if MIN11_HAS_RVALREFS
+		template<typename Func>
+		explicit thread(Func&& f)
+			: t(0)
+		{
+			start(new detail::thread_start_function<typename std::decay<Func>::type>(std::forward<Func>(f)), 0);
+		}
+
+		template<typename Func>
+		thread(const thread_attributes& attr, Func&& f)
+			: t(0)
+		{
+			start(new detail::thread_start_function<typename std::decay<Func>::type>(std::forward<Func>(f)), &attr);
+		}
+
+		thread(thread&& rhs)
+			: t(rhs.t)
+		{
+			rhs.t = 0;
+		}
+
+		thread& operator=(thread&& rhs)
+		{
+			if (t)
+				std::terminate();
+			t = rhs.t;
+			rhs.t = 0;
+			return *this;
+		}
+#else
+		template<typename Func>
+		explicit thread(const Func& f)
+			: t(0)
+		{
+			start(new detail::thread_start_function<Func>(f), 0);
+		}
+
+		template<typename Func>
+		thread(const thread_attributes& attr, const Func& f)
+			: t(0)
+		{
+			start(new detail::thread_start_function<Func>(f), &attr);
+		}
+#endif
+
+		// as std::thread, destroying a joinable thread terminates
+		~thread()
+		{
+			if (t)
+				std::terminate();
+		}
+
+		bool joinable() const
+		{
+			return t != 0;
+		}
+
+		void join()
+		{
+			if (!t)
+				detail::throw_thread_error("thread is not joinable");
+
+			detail::join_thread(t);
+			t = 0;
+		}
+
+		void detach()
+		{
+			if (!t)
+				detail::throw_thread_error("thread is not joinable");
+
+			detail::detach_thread(t);
+			t = 0;
+		}
+
+		id get_id() const
+		{
+			return t ? detail::thread_id(t) : 0;
+		}
+
+		void swap(thread& other)
+		{
+			detail::thread_internal* tmp = t;
+			t = other.t;
+			other.t = tmp;
+		}
+
+		static unsigned hardware_concurrency()
+		{
+			return detail::hardware_concurrency();
+		}
+
+	private:
+		thread(const thread&); // = delete;
+		thread& operator=(const thread&); // = delete;
+
+		void start(detail::thread_start* start, const thread_attributes* attr)
+		{
+			t = detail::create_thread(&detail::thread_start::entry, start, attr);
+			if (!t)
+			{
+				delete start;
+				detail::throw_thread_error("failed to create thread");
+			}
+		}
+
+		detail::thread_internal* t;
+	};
+
+	namespace this_thread
+	{
+		inline thread::id get_id()
+		{
+			return detail::current_thread_id();
+		}
+
+		inline void yield()
+		{
+			detail::yield_thread();
+		}
+	}
+}
+
+#endif // MIN11__THREAD_H
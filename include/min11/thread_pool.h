@@ -0,0 +1,493 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__THREAD_POOL_H
+#define MIN11__THREAD_POOL_H
+
+#include "condition_variable.h"
+#include "executor.h"
+#include "future.h"
+#include "mutex.h"
+#include "thread.h"
+
+#include <algorithm> // std::push_heap, std::pop_heap
+#include <stddef.h> // size_t
+#include <vector>
+
+namespace min11
+{
+	/**
+	 * Fixed set of worker threads servicing a shared queue of tasks.
+	 * Satisfies the executor requirements (see executor.h).
+	 *
+	 * Tasks carry a priority class (normal unless given) or a deadline.
+	 * Workers take tasks with a deadline first, earliest deadline first,
+	 * then the oldest task of the highest non-empty class. A non-empty
+	 * queue passed over `starvation_limit' times in a row is served
+	 * next, so batch work keeps progressing under interactive load.
+	 *
+	 * A task waiting on a future (or a parallel_for, task_graph or
+	 * pipeline run) does not block its worker: the worker runs other
+	 * pending tasks until the wait is satisfied, so nested parallelism
+	 * cannot starve the pool. Helped tasks run on the waiting task's
+	 * stack, so a task must not hold a lock another task needs while it
+	 * waits. A worker already nested `help_depth_limit' waits deep
+	 * blocks instead of helping, bounding its stack; waits nested
+	 * deeper than that then rely on the other workers to progress.
+	 */
+	class thread_pool
+	{
+	public:
+		enum priority
+		{
+			priority_high, // interactive work
+			priority_normal,
+			priority_low // batch work
+		};
+
+		enum
+		{
+			starvation_limit = 16,
+			help_depth_limit = 128
+		};
+
+		// start `threads' workers; 0 starts one per hardware thread
+		explicit thread_pool(unsigned threads = 0)
+			: queued(0)
+			, next_seq(0)
+			, idle(0)
+			, stopping(false)
+		{
+			start(threads, 0);
+		}
+
+		// start `threads' workers created with `attr'
+		thread_pool(unsigned threads, const thread_attributes& attr)
+			: queued(0)
+			, next_seq(0)
+			, idle(0)
+			, stopping(false)
+		{
+			start(threads, &attr);
+		}
+
+		// run every pending task, then join the workers
+		~thread_pool()
+		{
+			stop();
+		}
+
+		void submit(detail::task* t)
+		{
+			submit(t, priority_normal);
+		}
+
+		// queue `t' behind the pending tasks of class `p'
+		void submit(detail::task* t, priority p)
+		{
+			unique_lock<mutex> lock(mtx);
+			task_list& q = lists[p];
+			t->next = 0;
+			if (q.tail)
+				q.tail->next = t;
+			else
+				q.head = t;
+			q.tail = t;
+
+			++queued;
+			if (idle)
+				cond.notify_one();
+		}
+
+		// queue `t' to run by `deadline', in milliseconds on now()'s
+		// clock
+		void submit_by(detail::task* t, unsigned long long deadline)
+		{
+			unique_lock<mutex> lock(mtx);
+			const deadline_entry entry = {deadline, next_seq++, t};
+			deadlines.push_back(entry);
+			std::push_heap(deadlines.begin(), deadlines.end(), &deadline_entry::later);
+
+			++queued;
+			if (idle)
+				cond.notify_one();
+		}
+
+#if MIN11_HAS_RVALREFS
+		template<typename Func>
+		void post(Func&& f)
+		{
+			submit(detail::make_task(std::forward<Func>(f)));
+		}
+#else
+		template<typename Func>
+		void post(const Func& f)
+		{
+			submit(detail::make_task(f));
+		}
+#endif
+
+		// post `f' as a task of class `p'
+		template<typename Func>
+		void post(const Func& f, priority p)
+		{
+			submit(detail::make_task(f), p);
+		}
+
+		// post `f' to run by `deadline' (see submit_by)
+		template<typename Func>
+		void post_by(const Func& f, unsigned long long deadline)
+		{
+			submit_by(detail::make_task(f), deadline);
+		}
+
+		// post `f', skipping it if stop is requested on `token' before
+		// a worker picks it up
+		template<typename Func>
+		void post(const Func& f, const stop_token& token)
+		{
+			min11::post(*this, f, token);
+		}
+
+		unsigned size() const
+		{
+			return nworkers;
+		}
+
+		// clock deadlines are measured on
+		static unsigned long long now()
+		{
+			return detail::monotonic_milliseconds();
+		}
+
+	private:
+		thread_pool(const thread_pool&); // = delete;
+		thread_pool& operator=(const thread_pool&); // = delete;
+
+		enum
+		{
+			priority_count = priority_low + 1,
+			queue_count = priority_count + 1 // deadlines come first
+		};
+
+		struct task_list
+		{
+			detail::task* head;
+			detail::task* tail;
+		};
+
+		struct deadline_entry
+		{
+			unsigned long long deadline;
+			unsigned long long seq; // keeps equal deadlines FIFO
+			detail::task* t;
+
+			// heap order: the earliest deadline on top
+			static bool later(const deadline_entry& a, const deadline_entry& b)
+			{
+				if (a.deadline != b.deadline)
+					return a.deadline > b.deadline;
+				return a.seq > b.seq;
+			}
+		};
+
+		void start(unsigned threads, const thread_attributes* attr)
+		{
+			for (int ii = 0; ii < priority_count; ++ii)
+			{
+				lists[ii].head = 0;
+				lists[ii].tail = 0;
+			}
+
+			for (int ii = 0; ii < queue_count; ++ii)
+				passed[ii] = 0;
+
+			nworkers = threads ? threads : detail::hardware_concurrency();
+			if (nworkers == 0)
+				nworkers = 1;
+
+			workers = new detail::thread_internal*[nworkers];
+			for (unsigned ii = 0; ii < nworkers; ++ii)
+			{
+				workers[ii] = detail::create_thread(&thread_pool::worker_main, this, attr);
+				if (!workers[ii])
+				{
+					nworkers = ii;
+					stop();
+					detail::throw_thread_error("failed to create thread pool worker");
+				}
+			}
+		}
+
+		void stop()
+		{
+			{
+				unique_lock<mutex> lock(mtx);
+				stopping = true;
+				cond.notify_all();
+			}
+
+			for (unsigned ii = 0; ii < nworkers; ++ii)
+				detail::join_thread(workers[ii]);
+			delete[] workers;
+		}
+
+		/**
+		 * Waiter a helping worker checks between tasks
+		 */
+		class help_waiter : public detail::future_waiter
+		{
+		public:
+			explicit help_waiter(thread_pool* pool)
+				: pool(pool)
+				, ready(false)
+				, sleeping(false)
+				, blocking(false)
+			{
+			}
+
+			virtual void notify()
+			{
+				// `this' may be gone once `ready' is observed: only the
+				// pool is touched after setting it
+				thread_pool* p = pool;
+				unique_lock<mutex> lock(p->mtx);
+				const bool wake = sleeping;
+				const bool blocked = blocking;
+				ready = true;
+				if (wake)
+				{
+					if (blocked)
+						p->blocked.notify_all();
+					else
+						p->cond.notify_all();
+				}
+			}
+
+			thread_pool* pool;
+			bool ready;
+			bool sleeping;
+			bool blocking; // waits on `blocked', taking no tasks
+		};
+
+		/**
+		 * Installed on every worker: waits run pending tasks instead of
+		 * blocking the thread
+		 */
+		class helper : public detail::wait_hook
+		{
+		public:
+			explicit helper(thread_pool* pool)
+				: pool(pool)
+				, depth(0)
+			{
+			}
+
+			virtual void suspend(bool (*add)(void*, detail::future_waiter*), void* object)
+			{
+				if (!add)
+				{
+					detail::task* t = 0;
+					if (depth < help_depth_limit)
+					{
+						unique_lock<mutex> lock(pool->mtx);
+						t = pool->pop_with_lock();
+					}
+
+					if (t)
+					{
+						++depth;
+						t->run();
+						--depth;
+					}
+					else
+					{
+						detail::yield_thread();
+					}
+					return;
+				}
+
+				help_waiter w(pool);
+				if (!add(object, &w))
+					return;
+
+				if (depth < help_depth_limit)
+				{
+					++depth;
+					pool->help(w);
+					--depth;
+				}
+				else
+				{
+					pool->block(w);
+				}
+			}
+
+		private:
+			thread_pool* pool;
+			unsigned depth; // waits helping on this worker's stack
+		};
+
+		// run pending tasks until `w' is notified
+		void help(help_waiter& w)
+		{
+			unique_lock<mutex> lock(mtx);
+			while (!w.ready)
+			{
+				detail::task* t = pop_with_lock();
+				if (!t)
+				{
+					++idle;
+					w.sleeping = true;
+					cond.wait(lock);
+					w.sleeping = false;
+					--idle;
+					continue;
+				}
+
+				lock.mutex()->unlock();
+				t->run();
+				lock.mutex()->lock();
+			}
+		}
+
+		// wait for `w' without running tasks. Sleeps on `blocked' so as
+		// not to take a wakeup meant for a worker that would run a task.
+		void block(help_waiter& w)
+		{
+			unique_lock<mutex> lock(mtx);
+			w.blocking = true;
+			while (!w.ready)
+			{
+				w.sleeping = true;
+				blocked.wait(lock);
+				w.sleeping = false;
+			}
+		}
+
+		bool queue_empty_with_lock(int queue) const
+		{
+			if (queue == 0)
+				return deadlines.empty();
+			return !lists[queue - 1].head;
+		}
+
+		// Take the next task: the first non-empty queue, unless a later
+		// one has been passed over `starvation_limit' times. Queue 0
+		// holds tasks with a deadline, the rest one priority class each.
+		detail::task* pop_with_lock()
+		{
+			if (!queued)
+				return 0;
+
+			int pick = -1;
+			for (int ii = 0; ii < queue_count; ++ii)
+			{
+				if (queue_empty_with_lock(ii))
+				{
+					passed[ii] = 0;
+				}
+				else if (pick < 0)
+				{
+					pick = ii;
+				}
+				else if (passed[ii] >= starvation_limit)
+				{
+					pick = ii;
+					break;
+				}
+			}
+
+			for (int ii = pick + 1; ii < queue_count; ++ii)
+			{
+				if (!queue_empty_with_lock(ii))
+					++passed[ii];
+			}
+			passed[pick] = 0;
+			--queued;
+
+			if (pick == 0)
+			{
+				std::pop_heap(deadlines.begin(), deadlines.end(), &deadline_entry::later);
+				detail::task* t = deadlines.back().t;
+				deadlines.pop_back();
+				return t;
+			}
+
+			task_list& q = lists[pick - 1];
+			detail::task* t = q.head;
+			q.head = t->next;
+			if (!q.head)
+				q.tail = 0;
+			return t;
+		}
+
+		static void worker_main(void* arg)
+		{
+			thread_pool* pool = static_cast<thread_pool*>(arg);
+			helper hook(pool);
+			detail::set_current_wait_hook(&hook);
+			for (;;)
+			{
+				detail::task* t;
+				{
+					unique_lock<mutex> lock(pool->mtx);
+					while (!pool->queued && !pool->stopping)
+					{
+						++pool->idle;
+						pool->cond.wait(lock);
+						--pool->idle;
+					}
+
+					t = pool->pop_with_lock();
+				}
+
+				if (!t)
+				{
+					detail::set_current_wait_hook(0);
+					return;
+				}
+
+				t->run();
+			}
+		}
+
+		mutex mtx;
+		condition_variable cond;
+		condition_variable blocked;
+		task_list lists[priority_count];
+		std::vector<deadline_entry> deadlines;
+		unsigned passed[queue_count];
+		size_t queued;
+		unsigned long long next_seq;
+		unsigned idle;
+		bool stopping;
+		unsigned nworkers;
+		detail::thread_internal** workers;
+	};
+}
+
+#endif // MIN11__THREAD_POOL_H
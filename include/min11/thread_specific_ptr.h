@@ -0,0 +1,170 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__THREAD_SPECIFIC_PTR_H
+#define MIN11__THREAD_SPECIFIC_PTR_H
+
+#include "config.h"
+
+#include <stddef.h> // size_t
+
+namespace min11
+{
+	namespace detail
+	{
+		// per-thread table of values, indexed by a slot handed out by
+		// tls_allocate. Slots past `size' have never been set on this
+		// thread and read as 0.
+		struct tls_block
+		{
+			void** slots;
+			size_t size;
+			tls_block* next;
+			tls_block* prev;
+		};
+
+		// reserve a slot. cleanup(context, value) is called for each
+		// thread's non-null value when that thread exits.
+		size_t tls_allocate(void (*cleanup)(void*, void*), void* context);
+
+		// release a slot, clearing (without cleaning up) the value held
+		// by every thread
+		void tls_free(size_t slot);
+
+		// store a value for the calling thread, growing its table and
+		// registering thread-exit cleanup as needed
+		void tls_set(size_t slot, void* value);
+
+		// run cleanup for the calling thread's values and release its
+		// table. Called automatically at thread exit.
+		void tls_thread_exit();
+
+#if MIN11_HAS_COMPILER_TLS
+		extern MIN11_THREAD_LOCAL tls_block tls_current;
+
+		inline void* tls_get(size_t slot)
+		{
+			const tls_block& block = tls_current;
+			return slot < block.size ? block.slots[slot] : 0;
+		}
+#else
+		// one platform TLS lookup for the calling thread's table
+		void* tls_get(size_t slot);
+#endif
+	}
+
+	/**
+	 * Pointer with a separate value for each thread, modeled after
+	 * boost::thread_specific_ptr.
+	 *
+	 * When the compiler supports thread-local variables, get() is an
+	 * inline bounds check and load with no library call. Each thread's
+	 * value is passed to the cleanup function (delete by default) when
+	 * the thread exits.
+	 */
+	template<typename T>
+	class thread_specific_ptr
+	{
+	public:
+		thread_specific_ptr()
+			: cleanup(&default_cleanup)
+		{
+			slot = detail::tls_allocate(&cleanup_thunk, this);
+		}
+
+		// a null cleanup function leaves values alone at thread exit
+		explicit thread_specific_ptr(void (*cleanup)(T*))
+			: cleanup(cleanup)
+		{
+			slot = detail::tls_allocate(&cleanup_thunk, this);
+		}
+
+		// cleans up the calling thread's value. Values still held by
+		// other threads are not cleaned up.
+		~thread_specific_ptr()
+		{
+			reset();
+			detail::tls_free(slot);
+		}
+
+		T* get() const
+		{
+			return static_cast<T*>(detail::tls_get(slot));
+		}
+
+		T* operator->() const
+		{
+			return get();
+		}
+
+		T& operator*() const
+		{
+			return *get();
+		}
+
+		// give up ownership of the calling thread's value
+		T* release()
+		{
+			T* p = get();
+			if (p)
+				detail::tls_set(slot, 0);
+			return p;
+		}
+
+		// replace the calling thread's value, cleaning up the old one
+		void reset(T* p = 0)
+		{
+			T* old = get();
+			if (old == p)
+				return;
+
+			detail::tls_set(slot, p);
+			if (old && cleanup)
+				cleanup(old);
+		}
+
+	private:
+		thread_specific_ptr(const thread_specific_ptr&); // = delete;
+		thread_specific_ptr& operator=(const thread_specific_ptr&); // = delete;
+
+		static void default_cleanup(T* p)
+		{
+			delete p;
+		}
+
+		static void cleanup_thunk(void* context, void* value)
+		{
+			thread_specific_ptr* self = static_cast<thread_specific_ptr*>(context);
+			if (self->cleanup)
+				self->cleanup(static_cast<T*>(value));
+		}
+
+		size_t slot;
+		void (*cleanup)(T*);
+	};
+}
+
+#endif // MIN11__THREAD_SPECIFIC_PTR_H
@@ -0,0 +1,486 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MIN11__TIMER_SERVICE_H
+#define MIN11__TIMER_SERVICE_H
+
+#include "condition_variable.h"
+#include "executor.h"
+#include "future.h"
+#include "mutex.h"
+#include "thread.h"
+
+namespace min11
+{
+	namespace detail
+	{
+		/**
+		 * Entry in a timing wheel slot. Nodes are recycled rather than
+		 * freed; `generation' changes each time a node is reused so a
+		 * stale handle cannot cancel someone else's timer.
+		 */
+		struct timer_node
+		{
+			timer_node* next;
+			timer_node** pprev;
+			unsigned long long expiry;
+			unsigned long generation;
+			task* work;
+		};
+
+		/**
+		 * Task fulfilling a promise<void>. Destroyed without running,
+		 * it breaks the promise instead.
+		 */
+		class promise_task : public task
+		{
+		public:
+			promise_task()
+				: fired(false)
+			{
+			}
+
+			virtual ~promise_task()
+			{
+				if (!fired)
+				{
+#if MIN11_HAS_EXCEPTIONS
+					p.set_exception(future_error("broken promise"));
+#else
+					p.set_exception(static_cast<const char*>("broken promise"));
+#endif
+				}
+			}
+
+			virtual void run()
+			{
+				fired = true;
+				p.set_value();
+				delete this;
+			}
+
+			promise<void> p;
+
+		private:
+			bool fired;
+		};
+	}
+
+	/**
+	 * Timers on a hierarchical timing wheel (Varghese & Lauck): four
+	 * levels of 256 slots, the first one tick wide and each following
+	 * level 256 times coarser. Arming and cancelling a timer are O(1);
+	 * a timer is moved to a finer level at most three times before it
+	 * fires.
+	 *
+	 * Times are milliseconds on the clock returned by now(). Timers
+	 * fire on the service's own thread, no earlier than requested and
+	 * up to one tick late; long running work should be posted to an
+	 * executor. Between timers the thread sleeps until the next
+	 * occupied slot or cascade rather than waking every tick.
+	 *
+	 * Destroying the service discards pending timers. Futures returned
+	 * by after() for them become ready holding future_error.
+	 */
+	class timer_service
+	{
+	public:
+		typedef unsigned long long time_point;
+
+#if MIN11_HAS_RVALREFS
+		typedef future<void> result_future;
+#else
+		typedef detail::movable_future<void> result_future;
+#endif
+
+		/**
+		 * Handle used to cancel a scheduled function
+		 */
+		class timer
+		{
+		public:
+			timer()
+				: node(0)
+				, generation(0)
+			{
+			}
+
+		private:
+			friend class timer_service;
+
+			timer(detail::timer_node* node, unsigned long generation)
+				: node(node)
+				, generation(generation)
+			{
+			}
+
+			detail::timer_node* node;
+			unsigned long generation;
+		};
+
+		// `tick_ms' sets the resolution of the wheel
+		explicit timer_service(unsigned tick_ms = 1)
+			: tick(tick_ms ? tick_ms : 1)
+			, current(0)
+			, pending(0)
+			, sleeping_until(0)
+			, stopping(false)
+			, free_nodes(0)
+			, blocks(0)
+		{
+			for (int ii = 0; ii < levels * slots; ++ii)
+				wheel[ii] = 0;
+
+			worker = detail::create_thread(&timer_service::timer_main, this);
+			if (!worker)
+				detail::throw_thread_error("failed to create timer thread");
+		}
+
+		~timer_service()
+		{
+			{
+				unique_lock<mutex> lock(mtx);
+				stopping = true;
+				cond.notify_one();
+			}
+
+			detail::join_thread(worker);
+
+			for (int ii = 0; ii < levels * slots; ++ii)
+			{
+				for (detail::timer_node* node = wheel[ii]; node; node = node->next)
+					delete node->work;
+			}
+
+			while (blocks)
+			{
+				node_block* next = blocks->next;
+				delete blocks;
+				blocks = next;
+			}
+		}
+
+		static time_point now()
+		{
+			return detail::monotonic_milliseconds();
+		}
+
+		// future made ready once `ms' milliseconds have passed
+		result_future after(unsigned long ms)
+		{
+			detail::promise_task* t = new detail::promise_task;
+			result_future f = t->p.get_future();
+			arm(now() + ms, t);
+			return f;
+		}
+
+		// call `f' on the timer thread at time `when'
+		template<typename Func>
+		timer schedule_at(time_point when, const Func& f)
+		{
+			return arm(when, detail::make_task(f));
+		}
+
+		// call `f' on the timer thread once `ms' milliseconds have passed
+		template<typename Func>
+		timer schedule_after(unsigned long ms, const Func& f)
+		{
+			return arm(now() + ms, detail::make_task(f));
+		}
+
+		// cancel a function that has not started yet. Returns false if
+		// it already ran, is running, or was cancelled.
+		bool cancel(const timer& t)
+		{
+			detail::task* work = 0;
+			{
+				unique_lock<mutex> lock(mtx);
+				detail::timer_node* node = t.node;
+				if (!node || node->generation != t.generation || !node->pprev)
+					return false;
+
+				unlink(node);
+				work = node->work;
+				release_node(node);
+				--pending;
+			}
+
+			delete work;
+			return true;
+		}
+
+	private:
+		timer_service(const timer_service&); // = delete;
+		timer_service& operator=(const timer_service&); // = delete;
+
+		enum
+		{
+			levels = 4,
+			slot_bits = 8,
+			slots = 1 << slot_bits,
+			slot_mask = slots - 1,
+			nodes_per_block = 64
+		};
+
+		struct node_block
+		{
+			node_block* next;
+			detail::timer_node nodes[nodes_per_block];
+		};
+
+		// ticks covered by one slot of level `level'
+		static unsigned long long span(int level)
+		{
+			return static_cast<unsigned long long>(1) << (slot_bits * level);
+		}
+
+		timer arm(time_point when, detail::task* work)
+		{
+			unique_lock<mutex> lock(mtx);
+			detail::timer_node* node = acquire_node();
+			node->work = work;
+
+			// an empty wheel may have fallen behind the clock
+			const unsigned long long now_tick = now() / tick;
+			if (!pending && current < now_tick)
+				current = now_tick;
+
+			// round up so timers never fire early
+			node->expiry = (when + tick - 1) / tick;
+			insert(node);
+
+			// wake the thread if it is idle or sleeping past this timer
+			if (0 == pending++ || node->expiry < sleeping_until)
+				cond.notify_one();
+
+			return timer(node, node->generation);
+		}
+
+		detail::timer_node* acquire_node()
+		{
+			if (!free_nodes)
+			{
+				node_block* block = new node_block;
+				block->next = blocks;
+				blocks = block;
+				for (int ii = 0; ii < nodes_per_block; ++ii)
+				{
+					block->nodes[ii].generation = 0;
+					block->nodes[ii].next = free_nodes;
+					free_nodes = &block->nodes[ii];
+				}
+			}
+
+			detail::timer_node* node = free_nodes;
+			free_nodes = node->next;
+			return node;
+		}
+
+		void release_node(detail::timer_node* node)
+		{
+			++node->generation;
+			node->pprev = 0;
+			node->work = 0;
+			node->next = free_nodes;
+			free_nodes = node;
+		}
+
+		void insert(detail::timer_node* node)
+		{
+			unsigned long long expiry = node->expiry;
+			if (expiry < current)
+				expiry = current;
+
+			const unsigned long long delta = expiry - current;
+			int level = 0;
+			while (level < levels - 1 && delta >= span(level + 1))
+				++level;
+
+			// beyond the wheel's span: park in the last level until
+			// the wheel comes round, then re-insert
+			if (delta >= span(levels))
+				expiry = current + span(levels) - 1;
+
+			const unsigned index = static_cast<unsigned>(expiry >> (slot_bits * level)) & slot_mask;
+			detail::timer_node** head = &wheel[level * slots + index];
+			node->next = *head;
+			node->pprev = head;
+			if (*head)
+				(*head)->pprev = &node->next;
+			*head = node;
+		}
+
+		static void unlink(detail::timer_node* node)
+		{
+			*node->pprev = node->next;
+			if (node->next)
+				node->next->pprev = node->pprev;
+		}
+
+		// move every node in a coarser slot down the wheel
+		void cascade(int level)
+		{
+			const unsigned index = static_cast<unsigned>(current >> (slot_bits * level)) & slot_mask;
+			detail::timer_node* node = wheel[level * slots + index];
+			wheel[level * slots + index] = 0;
+			while (node)
+			{
+				detail::timer_node* next = node->next;
+				insert(node);
+				node = next;
+			}
+		}
+
+		// The earliest tick needing advance(): an occupied level 0 slot,
+		// or a cascade of an occupied coarser slot. Nothing happens on
+		// the ticks before it.
+		unsigned long long next_event() const
+		{
+			unsigned long long next = ~0ull;
+			for (int level = 0; level < levels; ++level)
+			{
+				// first tick at or after `current' that processes a slot
+				// of this level
+				const unsigned long long width = span(level);
+				unsigned long long tick = (current + width - 1) & ~(width - 1);
+				for (int ii = 0; ii < slots && tick < next; ++ii, tick += width)
+				{
+					const unsigned index = static_cast<unsigned>(tick >> (slot_bits * level)) & slot_mask;
+					if (wheel[level * slots + index])
+					{
+						next = tick;
+						break;
+					}
+				}
+			}
+
+			return next;
+		}
+
+		// process the current tick, collecting work that is due
+		void advance(detail::task** due)
+		{
+			for (int level = 1; level < levels; ++level)
+			{
+				if (current & (span(level) - 1))
+					break;
+				cascade(level);
+			}
+
+			const unsigned index = static_cast<unsigned>(current) & slot_mask;
+			detail::timer_node* node = wheel[index];
+			wheel[index] = 0;
+			while (node)
+			{
+				detail::timer_node* next = node->next;
+				node->work->next = *due;
+				*due = node->work;
+				release_node(node);
+				--pending;
+				node = next;
+			}
+
+			++current;
+		}
+
+		static void timer_main(void* arg)
+		{
+			timer_service* service = static_cast<timer_service*>(arg);
+			for (;;)
+			{
+				detail::task* due = 0;
+				{
+					unique_lock<mutex> lock(service->mtx);
+					while (!service->pending && !service->stopping)
+						service->cond.wait(lock);
+
+					if (service->stopping)
+						return;
+
+					// skip straight to each tick with something to do
+					const unsigned long long now_tick = now() / service->tick;
+					unsigned long long next = service->next_event();
+					while (next <= now_tick)
+					{
+						service->current = next;
+						service->advance(&due);
+						if (!service->pending)
+							break;
+						next = service->next_event();
+					}
+
+					if (!due)
+					{
+						if (service->pending)
+						{
+							const time_point wake = next * service->tick;
+							const time_point at = now();
+							if (wake > at)
+							{
+								const time_point delay = wake - at;
+								service->sleeping_until = next;
+								service->cond.wait_for(lock, (delay < 0xffffffffu) ? static_cast<unsigned long>(delay) : 0xffffffffu);
+								service->sleeping_until = 0;
+							}
+						}
+						continue;
+					}
+				}
+
+				// advance() collected newest first; restore arming order
+				detail::task* ordered = 0;
+				while (due)
+				{
+					detail::task* next = due->next;
+					due->next = ordered;
+					ordered = due;
+					due = next;
+				}
+
+				while (ordered)
+				{
+					detail::task* next = ordered->next;
+					ordered->run();
+					ordered = next;
+				}
+			}
+		}
+
+		mutex mtx;
+		condition_variable cond;
+		const unsigned tick;
+		unsigned long long current;
+		unsigned long pending;
+		unsigned long long sleeping_until; // tick the thread sleeps until, or 0
+		bool stopping;
+		detail::timer_node* wheel[levels * slots];
+		detail::timer_node* free_nodes;
+		node_block* blocks;
+		detail::thread_internal* worker;
+	};
+}
+
+#endif // MIN11__TIMER_SERVICE_H
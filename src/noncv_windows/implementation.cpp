@@ -26,7 +26,18 @@
 
 #include "min11/mutex.h"
 #include "min11/condition_variable.h"
+#include "min11/atomic.h"
 #include "min11/atomic_counter.h"
+#include "min11/fiber.h"
+#include "min11/future.h"
+#include "min11/queue_lock.h"
+#include "min11/thread.h"
+#include "min11/thread_specific_ptr.h"
+#include "min11/timer_service.h"
+
+#if MIN11_HAS_PARKING_LOT
+#	error MIN11_HAS_PARKING_LOT is only implemented by the pthreads backend
+#endif
 
 #if defined(_XBOX_VER)
 #	include <xtl.h>
@@ -35,6 +46,11 @@
 #	include <Windows.h>
 #endif
 #include <limits.h>
+#include <string.h>
+
+#if !defined(STACK_SIZE_PARAM_IS_A_RESERVATION)
+#	define STACK_SIZE_PARAM_IS_A_RESERVATION 0
+#endif
 
 using namespace min11;
 using namespace min11::detail;
@@ -58,6 +74,9 @@ mutex::~mutex()
 
 void mutex::lock()
 {
+	if (TRUE == TryEnterCriticalSection(&m->cs) || lock_as_fiber(this))
+		return;
+
 	EnterCriticalSection(&m->cs);
 }
 
@@ -73,6 +92,41 @@ void mutex::unlock()
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Windows offers no priority-inheritance protocol; the scheduler's boost of
+// starved ready threads is the nearest equivalent, so pi_mutex is a plain
+// critical section here.
+pi_mutex::pi_mutex()
+	: m(new mutex_internal)
+{
+	InitializeCriticalSection(&m->cs);
+}
+
+pi_mutex::~pi_mutex()
+{
+	DeleteCriticalSection(&m->cs);
+	delete m;
+}
+
+void pi_mutex::lock()
+{
+	if (TRUE == TryEnterCriticalSection(&m->cs) || lock_as_fiber(this))
+		return;
+
+	EnterCriticalSection(&m->cs);
+}
+
+bool pi_mutex::try_lock()
+{
+	return TRUE == TryEnterCriticalSection(&m->cs);
+}
+
+void pi_mutex::unlock()
+{
+	LeaveCriticalSection(&m->cs);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 struct min11::detail::condition_variable_internal
 {
 	volatile long waiters;
@@ -81,6 +135,7 @@ struct min11::detail::condition_variable_internal
 
 condition_variable::condition_variable()
 	: cv(new condition_variable_internal)
+	, fibers(NULL)
 {
 	cv->sema = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
 	cv->waiters = 0;
@@ -90,16 +145,72 @@ condition_variable::~condition_variable()
 {
 	CloseHandle(cv->sema);
 	delete cv;
+	delete fibers;
 }
 
 void condition_variable::wait(unique_lock<mutex>& lock)
 {
+	if (wait_as_fiber(&fibers, lock.mutex()))
+		return;
+
 	InterlockedIncrementRelease(&cv->waiters);
 	lock.mutex()->unlock();
 	WaitForSingleObject(cv->sema, INFINITE);
 	lock.mutex()->lock();
 }
 
+void condition_variable::wait(unique_lock<pi_mutex>& lock)
+{
+	if (wait_as_fiber(&fibers, lock.mutex()))
+		return;
+
+	InterlockedIncrementRelease(&cv->waiters);
+	lock.mutex()->unlock();
+	WaitForSingleObject(cv->sema, INFINITE);
+	lock.mutex()->lock();
+}
+
+// Wait for a release of the semaphore counted by a notify. On timeout
+// withdraw from the waiter count, unless a notify has already counted
+// this thread out and released the semaphore for it.
+static bool wait_semaphore_for(condition_variable_internal* cv, unsigned long ms)
+{
+	const DWORD timeout = (ms < INFINITE) ? static_cast<DWORD>(ms) : INFINITE - 1;
+	if (WAIT_OBJECT_0 == WaitForSingleObject(cv->sema, timeout))
+		return true;
+
+	for (;;)
+	{
+		long old = cv->waiters;
+		if (old == 0)
+		{
+			WaitForSingleObject(cv->sema, INFINITE);
+			return true;
+		}
+
+		if (old == InterlockedCompareExchange(&cv->waiters, old - 1, old))
+			return false;
+	}
+}
+
+bool condition_variable::wait_for(unique_lock<mutex>& lock, unsigned long ms)
+{
+	InterlockedIncrementRelease(&cv->waiters);
+	lock.mutex()->unlock();
+	const bool notified = wait_semaphore_for(cv, ms);
+	lock.mutex()->lock();
+	return notified;
+}
+
+bool condition_variable::wait_for(unique_lock<pi_mutex>& lock, unsigned long ms)
+{
+	InterlockedIncrementRelease(&cv->waiters);
+	lock.mutex()->unlock();
+	const bool notified = wait_semaphore_for(cv, ms);
+	lock.mutex()->lock();
+	return notified;
+}
+
 static void signal_cv(condition_variable_internal* cv, bool wakeAll)
 {
 	for (;;)
@@ -121,11 +232,13 @@ static void signal_cv(condition_variable_internal* cv, bool wakeAll)
 
 void condition_variable::notify_one()
 {
-	signal_cv(cv, false);
+	if (!notify_fibers(&fibers, false))
+		signal_cv(cv, false);
 }
 
 void condition_variable::notify_all()
 {
+	notify_fibers(&fibers, true);
 	signal_cv(cv, true);
 }
 
@@ -145,3 +258,658 @@ long atomic_counter::decr()
 {
 	return InterlockedDecrement(&value);
 }
+
+///////////////////////////////////////////////////////////////////////////////
+
+long min11::detail::atomic_load(const volatile long* p)
+{
+	long value = *p;
+	MemoryBarrier();
+	return value;
+}
+
+void min11::detail::atomic_store(volatile long* p, long value)
+{
+	InterlockedExchange(const_cast<long*>(p), value);
+}
+
+long min11::detail::atomic_exchange(volatile long* p, long value)
+{
+	return InterlockedExchange(const_cast<long*>(p), value);
+}
+
+long min11::detail::atomic_compare_exchange(volatile long* p, long expected, long desired)
+{
+	return InterlockedCompareExchange(const_cast<long*>(p), desired, expected);
+}
+
+long min11::detail::atomic_fetch_add(volatile long* p, long delta)
+{
+	return InterlockedExchangeAdd(const_cast<long*>(p), delta);
+}
+
+void* min11::detail::atomic_load_ptr(void* const volatile* p)
+{
+	void* value = *p;
+	MemoryBarrier();
+	return value;
+}
+
+void min11::detail::atomic_store_ptr(void* volatile* p, void* value)
+{
+	InterlockedExchangePointer(const_cast<void**>(p), value);
+}
+
+void* min11::detail::atomic_exchange_ptr(void* volatile* p, void* value)
+{
+	return InterlockedExchangePointer(const_cast<void**>(p), value);
+}
+
+void* min11::detail::atomic_compare_exchange_ptr(void* volatile* p, void* expected, void* desired)
+{
+	return InterlockedCompareExchangePointer(const_cast<void**>(p), desired, expected);
+}
+
+void min11::detail::atomic_fence()
+{
+	MemoryBarrier();
+}
+
+void min11::detail::cpu_relax()
+{
+	YieldProcessor();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct min11::detail::thread_internal
+{
+	HANDLE thread;
+	unsigned long id;
+};
+
+// owned by the new thread, so it stays valid after a detach
+struct thread_launch
+{
+	void (*entry)(void*);
+	void* arg;
+	char name[64];
+};
+
+#if defined(_MSC_VER) && !defined(_XBOX_VER)
+#pragma pack(push, 8)
+struct thread_name_info
+{
+	DWORD type;
+	LPCSTR name;
+	DWORD thread_id;
+	DWORD flags;
+};
+#pragma pack(pop)
+
+// name the thread for an attached debugger
+static void set_thread_name(const char* name)
+{
+	thread_name_info info;
+	info.type = 0x1000;
+	info.name = name;
+	info.thread_id = GetCurrentThreadId();
+	info.flags = 0;
+
+	__try
+	{
+		RaiseException(0x406D1388, 0, sizeof(info) / sizeof(ULONG_PTR), reinterpret_cast<ULONG_PTR*>(&info));
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER)
+	{
+	}
+}
+#else
+static void set_thread_name(const char*)
+{
+}
+#endif
+
+static DWORD WINAPI thread_entry(LPVOID arg)
+{
+	thread_launch* launch = static_cast<thread_launch*>(arg);
+	if (launch->name[0])
+		set_thread_name(launch->name);
+
+	void (*entry)(void*) = launch->entry;
+	void* entry_arg = launch->arg;
+	delete launch;
+
+	entry(entry_arg);
+	tls_thread_exit();
+	return 0;
+}
+
+static int thread_priority(const thread_attributes& attr)
+{
+	switch (attr.scheduling())
+	{
+	case thread_attributes::sched_fifo:
+	case thread_attributes::sched_round_robin:
+		return THREAD_PRIORITY_TIME_CRITICAL;
+	case thread_attributes::sched_batch:
+		return THREAD_PRIORITY_BELOW_NORMAL;
+	case thread_attributes::sched_idle:
+		return THREAD_PRIORITY_IDLE;
+	default:
+		return THREAD_PRIORITY_NORMAL;
+	}
+}
+
+thread_internal* min11::detail::create_thread(void (*entry)(void*), void* arg, const thread_attributes* attr)
+{
+	thread_launch* launch = new thread_launch;
+	launch->entry = entry;
+	launch->arg = arg;
+	launch->name[0] = '\0';
+	if (attr)
+		memcpy(launch->name, attr->name(), sizeof(launch->name));
+
+	thread_internal* t = new thread_internal;
+	DWORD id;
+	const SIZE_T stack = attr ? attr->stack_size() : 0;
+	t->thread = CreateThread(NULL, stack, thread_entry, launch, CREATE_SUSPENDED | STACK_SIZE_PARAM_IS_A_RESERVATION, &id);
+	t->id = id;
+	if (!t->thread)
+	{
+		delete launch;
+		delete t;
+		return NULL;
+	}
+
+	if (attr)
+	{
+		if (attr->has_affinity())
+		{
+			#if defined(_XBOX_VER)
+			// the title may only pin a thread to a single hardware thread
+			for (unsigned cpu = 0; cpu < 6; ++cpu)
+			{
+				if (attr->has_cpu(cpu))
+				{
+					XSetThreadProcessor(t->thread, cpu);
+					break;
+				}
+			}
+#else
+			DWORD_PTR mask = 0;
+			for (unsigned cpu = 0; cpu < sizeof(mask) * 8; ++cpu)
+			{
+				if (attr->has_cpu(cpu))
+					mask |= static_cast<DWORD_PTR>(1) << cpu;
+			}
+			SetThreadAffinityMask(t->thread, mask);
+#endif
+		}
+
+		if (attr->scheduling() != thread_attributes::sched_default)
+			SetThreadPriority(t->thread, thread_priority(*attr));
+	}
+
+	ResumeThread(t->thread);
+	return t;
+}
+
+void min11::detail::join_thread(thread_internal* t)
+{
+	WaitForSingleObject(t->thread, INFINITE);
+	CloseHandle(t->thread);
+	delete t;
+}
+
+void min11::detail::detach_thread(thread_internal* t)
+{
+	CloseHandle(t->thread);
+	delete t;
+}
+
+unsigned long min11::detail::thread_id(const thread_internal* t)
+{
+	return t->id;
+}
+
+unsigned min11::detail::hardware_concurrency()
+{
+#if defined(_XBOX_VER)
+	return 6;
+#else
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#endif
+}
+
+unsigned long min11::detail::current_thread_id()
+{
+	return GetCurrentThreadId();
+}
+
+void min11::detail::yield_thread()
+{
+	SwitchToThread();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long long min11::detail::monotonic_milliseconds()
+{
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	// split to keep counter * 1000 from overflowing
+	const unsigned long long ticks = static_cast<unsigned long long>(counter.QuadPart);
+	const unsigned long long rate = static_cast<unsigned long long>(frequency.QuadPart);
+	return (ticks / rate) * 1000 + (ticks % rate) * 1000 / rate;
+}
+
+void min11::detail::sleep_milliseconds(unsigned long ms)
+{
+	Sleep(ms);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct tls_entry
+{
+	void (*cleanup)(void*, void*);
+	void* context;
+	bool used;
+};
+
+// table operations are rare (slot allocation, a thread's first value,
+// thread exit) and need a lock usable before any constructor has run
+static volatile long tls_lock_word;
+static tls_entry* tls_entries;
+static size_t tls_nentries;
+static tls_block* tls_blocks; // every thread holding a table
+
+static void tls_lock()
+{
+	while (0 != atomic_compare_exchange(&tls_lock_word, 0, 1))
+		yield_thread();
+}
+
+static void tls_unlock()
+{
+	atomic_store(&tls_lock_word, 0);
+}
+
+static volatile long tls_initialized;
+
+#if MIN11_HAS_COMPILER_TLS
+MIN11_THREAD_LOCAL tls_block min11::detail::tls_current;
+
+static tls_block* current_block(bool)
+{
+	return &tls_current;
+}
+#else
+static DWORD tls_index;
+
+static tls_block* current_block(bool create)
+{
+	tls_block* block = static_cast<tls_block*>(TlsGetValue(tls_index));
+	if (!block && create)
+	{
+		block = new tls_block;
+		block->slots = NULL;
+		block->size = 0;
+		block->next = NULL;
+		block->prev = NULL;
+		TlsSetValue(tls_index, block);
+	}
+	return block;
+}
+
+void* min11::detail::tls_get(size_t slot)
+{
+	const tls_block* block = static_cast<tls_block*>(TlsGetValue(tls_index));
+	return (block && slot < block->size) ? block->slots[slot] : NULL;
+}
+#endif
+
+static void release_block(tls_block* block)
+{
+	if (!block || !block->slots)
+		return;
+
+	// cleanup functions may set values of their own; make a few passes,
+	// as pthreads does for key destructors
+	for (int pass = 0; pass < 4; ++pass)
+	{
+		bool ran = false;
+		for (size_t ii = 0; ii < block->size; ++ii)
+		{
+			void* value = block->slots[ii];
+			if (!value)
+				continue;
+
+			block->slots[ii] = NULL;
+
+			tls_lock();
+			const tls_entry entry = tls_entries[ii];
+			tls_unlock();
+
+			if (entry.used)
+				entry.cleanup(entry.context, value);
+			ran = true;
+		}
+
+		if (!ran)
+			break;
+	}
+
+	tls_lock();
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		tls_blocks = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+	void** slots = block->slots;
+	block->slots = NULL;
+	block->size = 0;
+	block->next = NULL;
+	block->prev = NULL;
+	tls_unlock();
+
+	delete[] slots;
+#if !MIN11_HAS_COMPILER_TLS
+	delete block;
+#endif
+}
+
+// called with tls_lock held
+static void tls_init()
+{
+#if !MIN11_HAS_COMPILER_TLS
+	tls_index = TlsAlloc();
+#endif
+
+	atomic_store(&tls_initialized, 1);
+}
+
+size_t min11::detail::tls_allocate(void (*cleanup)(void*, void*), void* context)
+{
+	tls_lock();
+	if (!tls_initialized)
+		tls_init();
+
+	size_t slot = 0;
+	while (slot < tls_nentries && tls_entries[slot].used)
+		++slot;
+
+	if (slot == tls_nentries)
+	{
+		const size_t count = tls_nentries ? tls_nentries * 2 : 16;
+		tls_entry* entries = new tls_entry[count];
+		for (size_t ii = 0; ii < count; ++ii)
+		{
+			if (ii < tls_nentries)
+				entries[ii] = tls_entries[ii];
+			else
+				entries[ii].used = false;
+		}
+
+		delete[] tls_entries;
+		tls_entries = entries;
+		tls_nentries = count;
+	}
+
+	tls_entries[slot].cleanup = cleanup;
+	tls_entries[slot].context = context;
+	tls_entries[slot].used = true;
+	tls_unlock();
+	return slot;
+}
+
+void min11::detail::tls_free(size_t slot)
+{
+	tls_lock();
+	tls_entries[slot].used = false;
+	for (tls_block* block = tls_blocks; block; block = block->next)
+	{
+		if (slot < block->size)
+			block->slots[slot] = NULL;
+	}
+	tls_unlock();
+}
+
+void min11::detail::tls_set(size_t slot, void* value)
+{
+	tls_block* block = current_block(value != NULL);
+	if (!block)
+		return;
+
+	if (slot >= block->size)
+	{
+		if (!value)
+			return;
+
+		size_t size = block->size ? block->size * 2 : 16;
+		while (size <= slot)
+			size *= 2;
+
+		void** slots = new void*[size];
+		for (size_t ii = 0; ii < size; ++ii)
+			slots[ii] = (ii < block->size) ? block->slots[ii] : NULL;
+
+		// swap tables under the lock so tls_free never walks a
+		// table that is being released
+		tls_lock();
+		void** old = block->slots;
+		if (!old)
+		{
+			block->prev = NULL;
+			block->next = tls_blocks;
+			if (tls_blocks)
+				tls_blocks->prev = block;
+			tls_blocks = block;
+		}
+		block->slots = slots;
+		block->size = size;
+		tls_unlock();
+
+		delete[] old;
+	}
+
+	block->slots[slot] = value;
+}
+
+#if MIN11_HAS_COMPILER_TLS
+static void mcs_thread_exit();
+#endif
+
+void min11::detail::tls_thread_exit()
+{
+#if MIN11_HAS_COMPILER_TLS
+	mcs_thread_exit();
+#endif
+
+	if (!atomic_load(&tls_initialized))
+		return;
+
+	tls_block* block = current_block(false);
+	if (block && block->slots)
+	{
+#if !MIN11_HAS_COMPILER_TLS
+		TlsSetValue(tls_index, NULL);
+#endif
+		release_block(block);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void free_mcs_nodes(mcs_node* node)
+{
+	while (node)
+	{
+		mcs_node* next = node->free_next;
+		delete node;
+		node = next;
+	}
+}
+
+// Per-thread free list of queue entries. An mcs_lock may be used from
+// static constructors and destructors, so the list lives in storage
+// needing no constructor; a min11::thread frees it when it exits.
+// Without compiler TLS no list is kept.
+#if MIN11_HAS_COMPILER_TLS
+static MIN11_THREAD_LOCAL mcs_node* mcs_free_head;
+
+static void mcs_thread_exit()
+{
+	free_mcs_nodes(mcs_free_head);
+	mcs_free_head = NULL;
+}
+
+mcs_node* min11::detail::acquire_mcs_node()
+{
+	mcs_node* node = mcs_free_head;
+	if (!node)
+		return new mcs_node;
+
+	mcs_free_head = node->free_next;
+	return node;
+}
+
+void min11::detail::release_mcs_node(mcs_node* node)
+{
+	node->free_next = mcs_free_head;
+	mcs_free_head = node;
+}
+#else
+mcs_node* min11::detail::acquire_mcs_node()
+{
+	return new mcs_node;
+}
+
+void min11::detail::release_mcs_node(mcs_node* node)
+{
+	delete node;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Hooks are owned by whoever installs them. Read by every contended wait,
+// so kept in storage needing no constructor: it is valid before this
+// file's static initialisers run and after its static destructors.
+#if MIN11_HAS_COMPILER_TLS
+static MIN11_THREAD_LOCAL wait_hook* wait_hook_current;
+
+wait_hook* min11::detail::current_wait_hook()
+{
+	return wait_hook_current;
+}
+
+void min11::detail::set_current_wait_hook(wait_hook* hook)
+{
+	wait_hook_current = hook;
+}
+#else
+static volatile long wait_hook_slot; // TLS index + 1, 0 until allocated
+
+static DWORD wait_hook_index()
+{
+	long slot = atomic_load(&wait_hook_slot);
+	if (!slot)
+	{
+		const DWORD index = TlsAlloc();
+		slot = atomic_compare_exchange(&wait_hook_slot, 0, static_cast<long>(index) + 1);
+		if (slot)
+			TlsFree(index);
+		else
+			slot = static_cast<long>(index) + 1;
+	}
+
+	return static_cast<DWORD>(slot - 1);
+}
+
+wait_hook* min11::detail::current_wait_hook()
+{
+	return static_cast<wait_hook*>(TlsGetValue(wait_hook_index()));
+}
+
+void min11::detail::set_current_wait_hook(wait_hook* hook)
+{
+	TlsSetValue(wait_hook_index(), hook);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+#if MIN11_HAS_FIBERS
+
+struct min11::detail::fiber_context
+{
+	LPVOID fiber;
+	bool converted; // thread converted by convert_thread_to_fiber
+	void (*entry)(void*);
+	void* arg;
+};
+
+static VOID CALLBACK fiber_start(LPVOID param)
+{
+	fiber_context* context = static_cast<fiber_context*>(param);
+	context->entry(context->arg);
+}
+
+fiber_context* min11::detail::create_fiber_context(void (*entry)(void*), void* arg, size_t stack_size)
+{
+	fiber_context* context = new fiber_context;
+	context->converted = false;
+	context->entry = entry;
+	context->arg = arg;
+	context->fiber = CreateFiber(stack_size, &fiber_start, context);
+	if (!context->fiber)
+	{
+		delete context;
+		return NULL;
+	}
+
+	return context;
+}
+
+void min11::detail::destroy_fiber_context(fiber_context* context)
+{
+	DeleteFiber(context->fiber);
+	delete context;
+}
+
+fiber_context* min11::detail::convert_thread_to_fiber()
+{
+	fiber_context* context = new fiber_context;
+	context->entry = NULL;
+	context->arg = NULL;
+	context->fiber = ConvertThreadToFiber(NULL);
+	context->converted = (context->fiber != NULL);
+
+	// the thread may already be running as a fiber
+	if (!context->fiber)
+		context->fiber = GetCurrentFiber();
+	return context;
+}
+
+void min11::detail::release_thread_fiber(fiber_context* context)
+{
+#if !defined(_XBOX_VER)
+	if (context->converted)
+		ConvertFiberToThread();
+#endif
+	delete context;
+}
+
+void min11::detail::switch_fiber_context(fiber_context*, fiber_context* to)
+{
+	SwitchToFiber(to->fiber);
+}
+
+#endif // MIN11_HAS_FIBERS
@@ -26,9 +26,56 @@
 
 #include "min11/mutex.h"
 #include "min11/condition_variable.h"
+#include "min11/atomic.h"
 #include "min11/atomic_counter.h"
+#include "min11/fiber.h"
+#include "min11/future.h"
+#include "min11/interprocess.h"
+#include "min11/io_reactor.h"
+#include "min11/queue_lock.h"
+#include "min11/thread.h"
+#include "min11/thread_specific_ptr.h"
+#include "min11/timer_service.h"
 
+#include <errno.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if MIN11_HAS_IO_REACTOR
+#	include <fcntl.h>
+#	include <stdint.h>
+#	include <sys/epoll.h>
+#	include <sys/eventfd.h>
+#	include <sys/socket.h>
+#	include <sys/stat.h>
+#endif
+
+#if MIN11_HAS_FIBERS
+#	include <stdint.h>
+#	include <stdlib.h>
+#	include <sys/mman.h>
+#	include <ucontext.h>
+#	if defined(__SANITIZE_THREAD__)
+#		define MIN11_TSAN_FIBERS 1
+#	elif defined(__has_feature)
+#		if __has_feature(thread_sanitizer)
+#			define MIN11_TSAN_FIBERS 1
+#		endif
+#	endif
+#	if defined(MIN11_TSAN_FIBERS)
+#		include <sanitizer/tsan_interface.h>
+#	endif
+#endif
+
+#if MIN11_HAS_INTERPROCESS
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
 
 using namespace min11;
 using namespace min11::detail;
@@ -38,6 +85,389 @@ struct min11::detail::mutex_internal
 	pthread_mutex_t mtx;
 };
 
+// timed waits use the monotonic clock where condition variables can be
+// told to
+#if defined(_POSIX_CLOCK_SELECTION) && _POSIX_CLOCK_SELECTION > 0
+static const clockid_t condition_clock = CLOCK_MONOTONIC;
+#else
+static const clockid_t condition_clock = CLOCK_REALTIME;
+#endif
+
+static void init_condition(pthread_cond_t* cond)
+{
+#if defined(_POSIX_CLOCK_SELECTION) && _POSIX_CLOCK_SELECTION > 0
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, condition_clock);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+#else
+	pthread_cond_init(cond, NULL);
+#endif
+}
+
+// absolute time on `condition_clock' `ms' milliseconds from now
+static timespec condition_deadline(unsigned long ms)
+{
+	timespec ts;
+	clock_gettime(condition_clock, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += static_cast<long>(ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000)
+	{
+		++ts.tv_sec;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	return ts;
+}
+
+#if MIN11_HAS_PARKING_LOT
+
+// Byte-sized atomics for the one-byte mutex and condition variable words
+static unsigned char byte_load(const volatile unsigned char* p)
+{
+#if defined(__ATOMIC_SEQ_CST)
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#else
+	__sync_synchronize();
+	const unsigned char value = *p;
+	__sync_synchronize();
+	return value;
+#endif
+}
+
+static void byte_store(volatile unsigned char* p, unsigned char value)
+{
+#if defined(__ATOMIC_SEQ_CST)
+	__atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+#else
+	__sync_synchronize();
+	*p = value;
+	__sync_synchronize();
+#endif
+}
+
+// returns the previous value
+static unsigned char byte_compare_exchange(volatile unsigned char* p, unsigned char expected, unsigned char desired)
+{
+#if defined(__ATOMIC_SEQ_CST)
+	__atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return expected;
+#else
+	return __sync_val_compare_and_swap(p, expected, desired);
+#endif
+}
+
+// Parking lot: threads blocked on a mutex or condition variable wait in
+// a global table of queues keyed by the object's address, so the objects
+// themselves own no OS resources. Each parked thread waits on its own
+// stack-allocated mutex/condition pair.
+struct parked_thread
+{
+	parked_thread* next;
+	const volatile void* address;
+	bool unparked; // guarded by `mtx'
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+};
+
+struct parking_bucket
+{
+	pthread_mutex_t mtx;
+	parked_thread* head;
+	parked_thread* tail;
+	char pad[MIN11_CACHE_LINE_SIZE];
+};
+
+static const size_t parking_bucket_count = 256;
+static parking_bucket parking_buckets[parking_bucket_count];
+static pthread_once_t parking_once = PTHREAD_ONCE_INIT;
+
+static void parking_init()
+{
+	for (size_t ii = 0; ii < parking_bucket_count; ++ii)
+	{
+		pthread_mutex_init(&parking_buckets[ii].mtx, NULL);
+		parking_buckets[ii].head = NULL;
+		parking_buckets[ii].tail = NULL;
+	}
+}
+
+static parking_bucket* bucket_for(const volatile void* address)
+{
+	pthread_once(&parking_once, parking_init);
+
+	size_t key = reinterpret_cast<size_t>(const_cast<const void*>(address)) >> 3;
+	key *= 2654435761u;
+	key ^= key >> 16;
+	return &parking_buckets[key & (parking_bucket_count - 1)];
+}
+
+enum park_result
+{
+	park_invalid, // validation failed; the thread never slept
+	park_unparked,
+	park_timed_out
+};
+
+// remove `thread' from its bucket's queue unless an unparker already has
+static bool unqueue_parked(parking_bucket* bucket, parked_thread* thread)
+{
+	pthread_mutex_lock(&bucket->mtx);
+	parked_thread* prev = NULL;
+	parked_thread* t = bucket->head;
+	while (t && t != thread)
+	{
+		prev = t;
+		t = t->next;
+	}
+
+	if (t)
+	{
+		if (prev)
+			prev->next = t->next;
+		else
+			bucket->head = t->next;
+		if (bucket->tail == t)
+			bucket->tail = prev;
+	}
+
+	pthread_mutex_unlock(&bucket->mtx);
+	return t != NULL;
+}
+
+// Queue the calling thread on `address' if `validate' returns true under
+// the bucket's lock, run `before_sleep' once queued and block until
+// unparked or, given a `deadline' on `condition_clock', until it passes.
+static park_result park(const volatile void* address, bool (*validate)(void*), void* validate_context, void (*before_sleep)(void*), void* sleep_context, const timespec* deadline)
+{
+	parking_bucket* bucket = bucket_for(address);
+
+	parked_thread self;
+	self.next = NULL;
+	self.address = address;
+	self.unparked = false;
+
+	pthread_mutex_lock(&bucket->mtx);
+	if (!validate(validate_context))
+	{
+		pthread_mutex_unlock(&bucket->mtx);
+		return park_invalid;
+	}
+
+	pthread_mutex_init(&self.mtx, NULL);
+	init_condition(&self.cond);
+	if (bucket->tail)
+		bucket->tail->next = &self;
+	else
+		bucket->head = &self;
+	bucket->tail = &self;
+	pthread_mutex_unlock(&bucket->mtx);
+
+	if (before_sleep)
+		before_sleep(sleep_context);
+
+	// the unparker signals with `self.mtx' held, so once it is released
+	// here nobody touches `self' again
+	park_result result = park_unparked;
+	pthread_mutex_lock(&self.mtx);
+	while (!self.unparked)
+	{
+		if (!deadline)
+		{
+			pthread_cond_wait(&self.cond, &self.mtx);
+			continue;
+		}
+
+		if (ETIMEDOUT != pthread_cond_timedwait(&self.cond, &self.mtx, deadline))
+			continue;
+
+		// leave the queue, unless an unparker has dequeued this thread
+		// and its wakeup is on the way
+		pthread_mutex_unlock(&self.mtx);
+		const bool unqueued = unqueue_parked(bucket, &self);
+		pthread_mutex_lock(&self.mtx);
+		if (unqueued)
+		{
+			result = park_timed_out;
+			break;
+		}
+
+		deadline = NULL;
+	}
+	pthread_mutex_unlock(&self.mtx);
+
+	pthread_cond_destroy(&self.cond);
+	pthread_mutex_destroy(&self.mtx);
+	return result;
+}
+
+static void wake_parked(parked_thread* thread)
+{
+	pthread_mutex_lock(&thread->mtx);
+	thread->unparked = true;
+	pthread_cond_signal(&thread->cond);
+	pthread_mutex_unlock(&thread->mtx);
+}
+
+// Dequeue the oldest thread parked on `address' and wake it. `callback'
+// runs under the bucket's lock with whether a thread was found and
+// whether others are still parked on the address.
+static void unpark_one(const volatile void* address, void (*callback)(bool, bool, void*), void* context)
+{
+	parking_bucket* bucket = bucket_for(address);
+	pthread_mutex_lock(&bucket->mtx);
+
+	parked_thread* prev = NULL;
+	parked_thread* found = bucket->head;
+	while (found && found->address != address)
+	{
+		prev = found;
+		found = found->next;
+	}
+
+	bool more = false;
+	if (found)
+	{
+		if (prev)
+			prev->next = found->next;
+		else
+			bucket->head = found->next;
+		if (bucket->tail == found)
+			bucket->tail = prev;
+
+		for (parked_thread* t = found->next; t && !more; t = t->next)
+			more = (t->address == address);
+	}
+
+	callback(found != NULL, more, context);
+	pthread_mutex_unlock(&bucket->mtx);
+
+	if (found)
+		wake_parked(found);
+}
+
+static void unpark_all(const volatile void* address)
+{
+	parking_bucket* bucket = bucket_for(address);
+	parked_thread* woken = NULL;
+
+	pthread_mutex_lock(&bucket->mtx);
+	parked_thread* prev = NULL;
+	for (parked_thread* t = bucket->head; t; )
+	{
+		parked_thread* next = t->next;
+		if (t->address == address)
+		{
+			if (prev)
+				prev->next = next;
+			else
+				bucket->head = next;
+			if (bucket->tail == t)
+				bucket->tail = prev;
+
+			t->next = woken;
+			woken = t;
+		}
+		else
+		{
+			prev = t;
+		}
+		t = next;
+	}
+	pthread_mutex_unlock(&bucket->mtx);
+
+	while (woken)
+	{
+		// `woken' may return from park() as soon as it is signalled
+		parked_thread* next = woken->next;
+		wake_parked(woken);
+		woken = next;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// mutex::state bits
+static const unsigned char mutex_locked = 1;
+static const unsigned char mutex_parked = 2; // threads may be parked
+
+static bool mutex_still_parked(void* state)
+{
+	return byte_load(static_cast<volatile unsigned char*>(state)) == (mutex_locked | mutex_parked);
+}
+
+static void mutex_unparked(bool, bool more, void* state)
+{
+	// releases the lock; a woken thread competes for it like any other
+	byte_store(static_cast<volatile unsigned char*>(state), more ? mutex_parked : 0);
+}
+
+mutex::mutex()
+	: state(0)
+{
+}
+
+mutex::~mutex()
+{
+}
+
+void mutex::lock()
+{
+	if (0 == byte_compare_exchange(&state, 0, mutex_locked) || lock_as_fiber(this))
+		return;
+
+	for (int spins = 0; ; )
+	{
+		const unsigned char s = byte_load(&state);
+		if (!(s & mutex_locked))
+		{
+			if (s == byte_compare_exchange(&state, s, s | mutex_locked))
+				return;
+			continue;
+		}
+
+		// briefly yield before parking: most holders release quickly
+		if (!(s & mutex_parked))
+		{
+			if (spins < 40)
+			{
+				++spins;
+				sched_yield();
+				continue;
+			}
+
+			if (s != byte_compare_exchange(&state, s, s | mutex_parked))
+				continue;
+		}
+
+		park(&state, mutex_still_parked, const_cast<unsigned char*>(&state), NULL, NULL, NULL);
+	}
+}
+
+bool mutex::try_lock()
+{
+	for (;;)
+	{
+		const unsigned char s = byte_load(&state);
+		if (s & mutex_locked)
+			return false;
+		if (s == byte_compare_exchange(&state, s, s | mutex_locked))
+			return true;
+	}
+}
+
+void mutex::unlock()
+{
+	if (mutex_locked == byte_compare_exchange(&state, mutex_locked, 0))
+		return;
+
+	unpark_one(&state, mutex_unparked, const_cast<unsigned char*>(&state));
+}
+
+#else // !MIN11_HAS_PARKING_LOT
+
 mutex::mutex()
 	: m(new mutex_internal)
 {
@@ -52,12 +482,15 @@ mutex::~mutex()
 
 void mutex::lock()
 {
+	if (0 == pthread_mutex_trylock(&m->mtx) || lock_as_fiber(this))
+		return;
+
 	pthread_mutex_lock(&m->mtx);
 }
 
 bool mutex::try_lock()
 {
-	return pthread_mutex_trylock(&m->mtx);
+	return 0 == pthread_mutex_trylock(&m->mtx);
 }
 
 void mutex::unlock()
@@ -65,8 +498,136 @@ void mutex::unlock()
 	pthread_mutex_unlock(&m->mtx);
 }
 
+#endif // MIN11_HAS_PARKING_LOT
+
+///////////////////////////////////////////////////////////////////////////////
+
+pi_mutex::pi_mutex()
+	: m(new mutex_internal)
+{
+#if defined(_POSIX_THREAD_PRIO_INHERIT) && _POSIX_THREAD_PRIO_INHERIT > 0
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&m->mtx, &attr);
+	pthread_mutexattr_destroy(&attr);
+#else
+	pthread_mutex_init(&m->mtx, NULL);
+#endif
+}
+
+pi_mutex::~pi_mutex()
+{
+	pthread_mutex_destroy(&m->mtx);
+	delete m;
+}
+
+void pi_mutex::lock()
+{
+	if (0 == pthread_mutex_trylock(&m->mtx) || lock_as_fiber(this))
+		return;
+
+	pthread_mutex_lock(&m->mtx);
+}
+
+bool pi_mutex::try_lock()
+{
+	return 0 == pthread_mutex_trylock(&m->mtx);
+}
+
+void pi_mutex::unlock()
+{
+	pthread_mutex_unlock(&m->mtx);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
+#if MIN11_HAS_PARKING_LOT
+
+static bool mark_waiting(void* has_waiters)
+{
+	byte_store(static_cast<volatile unsigned char*>(has_waiters), 1);
+	return true;
+}
+
+template<typename M>
+static void unlock_mutex(void* mtx)
+{
+	static_cast<M*>(mtx)->unlock();
+}
+
+static void condition_unparked(bool, bool more, void* has_waiters)
+{
+	byte_store(static_cast<volatile unsigned char*>(has_waiters), more ? 1 : 0);
+}
+
+condition_variable::condition_variable()
+	: has_waiters(0)
+	, fibers(NULL)
+{
+}
+
+condition_variable::~condition_variable()
+{
+	delete fibers;
+}
+
+// The lock is released only once the thread is queued, so a notify
+// issued after that cannot be missed. A waiter that times out leaves
+// `has_waiters' set; the next notify finds nobody and clears it.
+template<typename M>
+static bool wait_condition(volatile unsigned char* has_waiters, M* mtx, const timespec* deadline)
+{
+	const park_result result = park(has_waiters, mark_waiting, const_cast<unsigned char*>(has_waiters), unlock_mutex<M>, mtx, deadline);
+	mtx->lock();
+	return result != park_timed_out;
+}
+
+void condition_variable::wait(unique_lock<mutex>& lock)
+{
+	if (!wait_as_fiber(&fibers, lock.mutex()))
+		wait_condition(&has_waiters, lock.mutex(), NULL);
+}
+
+void condition_variable::wait(unique_lock<pi_mutex>& lock)
+{
+	if (!wait_as_fiber(&fibers, lock.mutex()))
+		wait_condition(&has_waiters, lock.mutex(), NULL);
+}
+
+bool condition_variable::wait_for(unique_lock<mutex>& lock, unsigned long ms)
+{
+	const timespec deadline = condition_deadline(ms);
+	return wait_condition(&has_waiters, lock.mutex(), &deadline);
+}
+
+bool condition_variable::wait_for(unique_lock<pi_mutex>& lock, unsigned long ms)
+{
+	const timespec deadline = condition_deadline(ms);
+	return wait_condition(&has_waiters, lock.mutex(), &deadline);
+}
+
+void condition_variable::notify_one()
+{
+	if (notify_fibers(&fibers, false))
+		return;
+
+	if (byte_load(&has_waiters))
+		unpark_one(&has_waiters, condition_unparked, const_cast<unsigned char*>(&has_waiters));
+}
+
+void condition_variable::notify_all()
+{
+	notify_fibers(&fibers, true);
+	if (byte_load(&has_waiters))
+	{
+		byte_store(&has_waiters, 0);
+		unpark_all(&has_waiters);
+	}
+}
+
+#else // !MIN11_HAS_PARKING_LOT
+
 struct min11::detail::condition_variable_internal
 {
 	pthread_cond_t cv;
@@ -74,31 +635,56 @@ struct min11::detail::condition_variable_internal
 
 condition_variable::condition_variable()
 	: cv(new condition_variable_internal)
+	, fibers(NULL)
 {
-	pthread_cond_init(&cv->cv, NULL);
+	init_condition(&cv->cv);
 }
 
 condition_variable::~condition_variable()
 {
 	pthread_cond_destroy(&cv->cv);
 	delete cv;
+	delete fibers;
 }
 
 void condition_variable::wait(unique_lock<mutex>& lock)
 {
-	pthread_cond_wait(&cv->cv, &lock.mutex()->m->mtx);
+	if (!wait_as_fiber(&fibers, lock.mutex()))
+		pthread_cond_wait(&cv->cv, &lock.mutex()->m->mtx);
+}
+
+void condition_variable::wait(unique_lock<pi_mutex>& lock)
+{
+	if (!wait_as_fiber(&fibers, lock.mutex()))
+		pthread_cond_wait(&cv->cv, &lock.mutex()->m->mtx);
+}
+
+bool condition_variable::wait_for(unique_lock<mutex>& lock, unsigned long ms)
+{
+	const timespec deadline = condition_deadline(ms);
+	return ETIMEDOUT != pthread_cond_timedwait(&cv->cv, &lock.mutex()->m->mtx, &deadline);
+}
+
+bool condition_variable::wait_for(unique_lock<pi_mutex>& lock, unsigned long ms)
+{
+	const timespec deadline = condition_deadline(ms);
+	return ETIMEDOUT != pthread_cond_timedwait(&cv->cv, &lock.mutex()->m->mtx, &deadline);
 }
 
 void condition_variable::notify_one()
 {
-	pthread_cond_signal(&cv->cv);
+	if (!notify_fibers(&fibers, false))
+		pthread_cond_signal(&cv->cv);
 }
 
 void condition_variable::notify_all()
 {
+	notify_fibers(&fibers, true);
 	pthread_cond_broadcast(&cv->cv);
 }
 
+#endif // MIN11_HAS_PARKING_LOT
+
 ///////////////////////////////////////////////////////////////////////////////
 
 atomic_counter::atomic_counter(long initial)
@@ -115,3 +701,1428 @@ long atomic_counter::decr()
 {
 	return __sync_sub_and_fetch(&value, 1);
 }
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Prefer the __atomic builtins (gcc 4.7+, clang), falling back to the
+// __sync builtins and full barriers for older compilers
+#if defined(__ATOMIC_SEQ_CST)
+
+long min11::detail::atomic_load(const volatile long* p)
+{
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+void min11::detail::atomic_store(volatile long* p, long value)
+{
+	__atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+long min11::detail::atomic_exchange(volatile long* p, long value)
+{
+	return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+void* min11::detail::atomic_load_ptr(void* const volatile* p)
+{
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+void min11::detail::atomic_store_ptr(void* volatile* p, void* value)
+{
+	__atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+void* min11::detail::atomic_exchange_ptr(void* volatile* p, void* value)
+{
+	return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+#else
+
+long min11::detail::atomic_load(const volatile long* p)
+{
+	long value = *p;
+	__sync_synchronize();
+	return value;
+}
+
+void min11::detail::atomic_store(volatile long* p, long value)
+{
+	__sync_synchronize();
+	*p = value;
+	__sync_synchronize();
+}
+
+long min11::detail::atomic_exchange(volatile long* p, long value)
+{
+	__sync_synchronize();
+	return __sync_lock_test_and_set(p, value);
+}
+
+void* min11::detail::atomic_load_ptr(void* const volatile* p)
+{
+	void* value = *p;
+	__sync_synchronize();
+	return value;
+}
+
+void min11::detail::atomic_store_ptr(void* volatile* p, void* value)
+{
+	__sync_synchronize();
+	*p = value;
+	__sync_synchronize();
+}
+
+void* min11::detail::atomic_exchange_ptr(void* volatile* p, void* value)
+{
+	__sync_synchronize();
+	return __sync_lock_test_and_set(p, value);
+}
+
+#endif
+
+long min11::detail::atomic_compare_exchange(volatile long* p, long expected, long desired)
+{
+	return __sync_val_compare_and_swap(p, expected, desired);
+}
+
+long min11::detail::atomic_fetch_add(volatile long* p, long delta)
+{
+	return __sync_fetch_and_add(p, delta);
+}
+
+void* min11::detail::atomic_compare_exchange_ptr(void* volatile* p, void* expected, void* desired)
+{
+	return __sync_val_compare_and_swap(p, expected, desired);
+}
+
+void min11::detail::atomic_fence()
+{
+#if defined(__ATOMIC_SEQ_CST)
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+#else
+	__sync_synchronize();
+#endif
+}
+
+void min11::detail::cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__("pause");
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct min11::detail::thread_internal
+{
+	pthread_t thread;
+};
+
+// owned by the new thread, so it stays valid after a detach
+struct thread_launch
+{
+	void (*entry)(void*);
+	void* arg;
+	char name[16];
+};
+
+static void* thread_entry(void* arg)
+{
+	thread_launch* launch = static_cast<thread_launch*>(arg);
+	if (launch->name[0])
+	{
+#if defined(__GLIBC__)
+		pthread_setname_np(pthread_self(), launch->name);
+#elif defined(__APPLE__)
+		pthread_setname_np(launch->name);
+#endif
+	}
+
+	void (*entry)(void*) = launch->entry;
+	void* entry_arg = launch->arg;
+	delete launch;
+
+	entry(entry_arg);
+	return NULL;
+}
+
+static bool apply_attributes(pthread_attr_t* pattr, const thread_attributes& attr)
+{
+	if (attr.stack_size())
+	{
+		size_t size = attr.stack_size();
+		if (size < static_cast<size_t>(PTHREAD_STACK_MIN))
+			size = PTHREAD_STACK_MIN;
+		if (0 != pthread_attr_setstacksize(pattr, size))
+			return false;
+	}
+
+#if defined(__GLIBC__)
+	if (attr.has_affinity())
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (unsigned cpu = 0; cpu < thread_attributes::max_cpus && cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (attr.has_cpu(cpu))
+				CPU_SET(cpu, &set);
+		}
+
+		if (0 != pthread_attr_setaffinity_np(pattr, sizeof(set), &set))
+			return false;
+	}
+#endif
+
+	if (attr.scheduling() != thread_attributes::sched_default)
+	{
+		int policy;
+		switch (attr.scheduling())
+		{
+		case thread_attributes::sched_fifo: policy = SCHED_FIFO; break;
+		case thread_attributes::sched_round_robin: policy = SCHED_RR; break;
+#if defined(SCHED_BATCH)
+		case thread_attributes::sched_batch: policy = SCHED_BATCH; break;
+#endif
+#if defined(SCHED_IDLE)
+		case thread_attributes::sched_idle: policy = SCHED_IDLE; break;
+#endif
+		default: policy = SCHED_OTHER; break;
+		}
+
+		sched_param param;
+		param.sched_priority = attr.scheduling_priority();
+		if (0 != pthread_attr_setinheritsched(pattr, PTHREAD_EXPLICIT_SCHED)
+			|| 0 != pthread_attr_setschedpolicy(pattr, policy)
+			|| 0 != pthread_attr_setschedparam(pattr, &param))
+			return false;
+	}
+
+	return true;
+}
+
+thread_internal* min11::detail::create_thread(void (*entry)(void*), void* arg, const thread_attributes* attr)
+{
+	pthread_attr_t pattr;
+	pthread_attr_init(&pattr);
+	if (attr && !apply_attributes(&pattr, *attr))
+	{
+		pthread_attr_destroy(&pattr);
+		return NULL;
+	}
+
+	thread_launch* launch = new thread_launch;
+	launch->entry = entry;
+	launch->arg = arg;
+	launch->name[0] = '\0';
+	if (attr)
+	{
+		// thread names are truncated to the platform's limit
+		const size_t length = strnlen(attr->name(), sizeof(launch->name) - 1);
+		memcpy(launch->name, attr->name(), length);
+		launch->name[length] = '\0';
+	}
+
+	thread_internal* t = new thread_internal;
+	const int err = pthread_create(&t->thread, &pattr, thread_entry, launch);
+	pthread_attr_destroy(&pattr);
+	if (err)
+	{
+		delete launch;
+		delete t;
+		return NULL;
+	}
+
+	return t;
+}
+
+void min11::detail::join_thread(thread_internal* t)
+{
+	pthread_join(t->thread, NULL);
+	delete t;
+}
+
+void min11::detail::detach_thread(thread_internal* t)
+{
+	pthread_detach(t->thread);
+	delete t;
+}
+
+unsigned long min11::detail::thread_id(const thread_internal* t)
+{
+	return (unsigned long)t->thread;
+}
+
+unsigned min11::detail::hardware_concurrency()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? static_cast<unsigned>(n) : 0;
+}
+
+unsigned long min11::detail::current_thread_id()
+{
+	return (unsigned long)pthread_self();
+}
+
+void min11::detail::yield_thread()
+{
+	sched_yield();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long long min11::detail::monotonic_milliseconds()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+void min11::detail::sleep_milliseconds(unsigned long ms)
+{
+	timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	while (-1 == nanosleep(&ts, &ts) && errno == EINTR)
+	{
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct tls_entry
+{
+	void (*cleanup)(void*, void*);
+	void* context;
+	bool used;
+};
+
+static pthread_mutex_t tls_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tls_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tls_exit_key;
+static tls_entry* tls_entries;
+static size_t tls_nentries;
+static tls_block* tls_blocks; // every thread holding a table
+
+#if MIN11_HAS_COMPILER_TLS
+MIN11_THREAD_LOCAL tls_block min11::detail::tls_current;
+
+static tls_block* current_block(bool)
+{
+	return &tls_current;
+}
+#else
+static tls_block* current_block(bool create)
+{
+	tls_block* block = static_cast<tls_block*>(pthread_getspecific(tls_exit_key));
+	if (!block && create)
+	{
+		block = new tls_block;
+		block->slots = NULL;
+		block->size = 0;
+		block->next = NULL;
+		block->prev = NULL;
+	}
+	return block;
+}
+
+void* min11::detail::tls_get(size_t slot)
+{
+	const tls_block* block = static_cast<tls_block*>(pthread_getspecific(tls_exit_key));
+	return (block && slot < block->size) ? block->slots[slot] : NULL;
+}
+#endif
+
+static void release_block(tls_block* block)
+{
+	if (!block || !block->slots)
+		return;
+
+	// cleanup functions may set values of their own; make a few passes,
+	// as pthreads does for key destructors
+	for (int pass = 0; pass < PTHREAD_DESTRUCTOR_ITERATIONS; ++pass)
+	{
+		bool ran = false;
+		for (size_t ii = 0; ii < block->size; ++ii)
+		{
+			void* value = block->slots[ii];
+			if (!value)
+				continue;
+
+			block->slots[ii] = NULL;
+
+			pthread_mutex_lock(&tls_lock);
+			const tls_entry entry = tls_entries[ii];
+			pthread_mutex_unlock(&tls_lock);
+
+			if (entry.used)
+				entry.cleanup(entry.context, value);
+			ran = true;
+		}
+
+		if (!ran)
+			break;
+	}
+
+	pthread_mutex_lock(&tls_lock);
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		tls_blocks = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+	void** slots = block->slots;
+	block->slots = NULL;
+	block->size = 0;
+	block->next = NULL;
+	block->prev = NULL;
+	pthread_mutex_unlock(&tls_lock);
+
+	delete[] slots;
+#if !MIN11_HAS_COMPILER_TLS
+	delete block;
+#endif
+}
+
+static void tls_exit_destructor(void* block)
+{
+	release_block(static_cast<tls_block*>(block));
+}
+
+static void tls_init()
+{
+	pthread_key_create(&tls_exit_key, tls_exit_destructor);
+}
+
+size_t min11::detail::tls_allocate(void (*cleanup)(void*, void*), void* context)
+{
+	pthread_once(&tls_once, tls_init);
+
+	pthread_mutex_lock(&tls_lock);
+	size_t slot = 0;
+	while (slot < tls_nentries && tls_entries[slot].used)
+		++slot;
+
+	if (slot == tls_nentries)
+	{
+		const size_t count = tls_nentries ? tls_nentries * 2 : 16;
+		tls_entry* entries = new tls_entry[count];
+		for (size_t ii = 0; ii < count; ++ii)
+		{
+			if (ii < tls_nentries)
+				entries[ii] = tls_entries[ii];
+			else
+				entries[ii].used = false;
+		}
+
+		delete[] tls_entries;
+		tls_entries = entries;
+		tls_nentries = count;
+	}
+
+	tls_entries[slot].cleanup = cleanup;
+	tls_entries[slot].context = context;
+	tls_entries[slot].used = true;
+	pthread_mutex_unlock(&tls_lock);
+	return slot;
+}
+
+void min11::detail::tls_free(size_t slot)
+{
+	pthread_mutex_lock(&tls_lock);
+	tls_entries[slot].used = false;
+	for (tls_block* block = tls_blocks; block; block = block->next)
+	{
+		if (slot < block->size)
+			block->slots[slot] = NULL;
+	}
+	pthread_mutex_unlock(&tls_lock);
+}
+
+void min11::detail::tls_set(size_t slot, void* value)
+{
+	tls_block* block = current_block(value != NULL);
+	if (!block)
+		return;
+
+	if (slot >= block->size)
+	{
+		if (!value)
+			return;
+
+		size_t size = block->size ? block->size * 2 : 16;
+		while (size <= slot)
+			size *= 2;
+
+		void** slots = new void*[size];
+		for (size_t ii = 0; ii < size; ++ii)
+			slots[ii] = (ii < block->size) ? block->slots[ii] : NULL;
+
+		// swap tables under the lock so tls_free never walks a
+		// table that is being released
+		pthread_mutex_lock(&tls_lock);
+		void** old = block->slots;
+		if (!old)
+		{
+			block->prev = NULL;
+			block->next = tls_blocks;
+			if (tls_blocks)
+				tls_blocks->prev = block;
+			tls_blocks = block;
+		}
+		block->slots = slots;
+		block->size = size;
+		pthread_mutex_unlock(&tls_lock);
+
+		if (old)
+			delete[] old;
+		else
+			pthread_setspecific(tls_exit_key, block);
+	}
+
+	block->slots[slot] = value;
+}
+
+void min11::detail::tls_thread_exit()
+{
+	pthread_once(&tls_once, tls_init);
+
+	tls_block* block = current_block(false);
+	if (block && block->slots)
+	{
+		pthread_setspecific(tls_exit_key, NULL);
+		release_block(block);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Per-thread free list of queue entries. An mcs_lock may be used from
+// static constructors and destructors, so the list lives in storage
+// needing no constructor; a key's destructor frees it at thread exit.
+static pthread_once_t mcs_once = PTHREAD_ONCE_INIT;
+static pthread_key_t mcs_exit_key;
+
+static void free_mcs_nodes(mcs_node* node)
+{
+	while (node)
+	{
+		mcs_node* next = node->free_next;
+		delete node;
+		node = next;
+	}
+}
+
+#if MIN11_HAS_COMPILER_TLS
+static MIN11_THREAD_LOCAL mcs_node* mcs_free_head;
+static MIN11_THREAD_LOCAL bool mcs_exit_armed;
+
+// the key's value is the exiting thread's list head
+static void mcs_thread_exit(void* head)
+{
+	mcs_node** p = static_cast<mcs_node**>(head);
+	free_mcs_nodes(*p);
+	*p = NULL;
+
+	// a later key destructor taking an mcs_lock arms it again
+	mcs_exit_armed = false;
+}
+
+static void mcs_init()
+{
+	pthread_key_create(&mcs_exit_key, mcs_thread_exit);
+}
+
+mcs_node* min11::detail::acquire_mcs_node()
+{
+	mcs_node* node = mcs_free_head;
+	if (!node)
+		return new mcs_node;
+
+	mcs_free_head = node->free_next;
+	return node;
+}
+
+void min11::detail::release_mcs_node(mcs_node* node)
+{
+	if (!mcs_exit_armed)
+	{
+		pthread_once(&mcs_once, mcs_init);
+		pthread_setspecific(mcs_exit_key, &mcs_free_head);
+		mcs_exit_armed = true;
+	}
+
+	node->free_next = mcs_free_head;
+	mcs_free_head = node;
+}
+#else
+// the key's value is the list head itself
+static void mcs_thread_exit(void* head)
+{
+	free_mcs_nodes(static_cast<mcs_node*>(head));
+}
+
+static void mcs_init()
+{
+	pthread_key_create(&mcs_exit_key, mcs_thread_exit);
+}
+
+mcs_node* min11::detail::acquire_mcs_node()
+{
+	pthread_once(&mcs_once, mcs_init);
+	mcs_node* node = static_cast<mcs_node*>(pthread_getspecific(mcs_exit_key));
+	if (!node)
+		return new mcs_node;
+
+	pthread_setspecific(mcs_exit_key, node->free_next);
+	return node;
+}
+
+void min11::detail::release_mcs_node(mcs_node* node)
+{
+	pthread_once(&mcs_once, mcs_init);
+	node->free_next = static_cast<mcs_node*>(pthread_getspecific(mcs_exit_key));
+	pthread_setspecific(mcs_exit_key, node);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Hooks are owned by whoever installs them. Read by every contended wait,
+// so kept in storage needing no constructor: it is valid before this
+// file's static initialisers run and after its static destructors.
+#if MIN11_HAS_COMPILER_TLS
+static MIN11_THREAD_LOCAL wait_hook* wait_hook_current;
+
+wait_hook* min11::detail::current_wait_hook()
+{
+	return wait_hook_current;
+}
+
+void min11::detail::set_current_wait_hook(wait_hook* hook)
+{
+	wait_hook_current = hook;
+}
+#else
+static pthread_once_t wait_hook_once = PTHREAD_ONCE_INIT;
+static pthread_key_t wait_hook_key;
+
+static void wait_hook_init()
+{
+	pthread_key_create(&wait_hook_key, NULL);
+}
+
+wait_hook* min11::detail::current_wait_hook()
+{
+	pthread_once(&wait_hook_once, wait_hook_init);
+	return static_cast<wait_hook*>(pthread_getspecific(wait_hook_key));
+}
+
+void min11::detail::set_current_wait_hook(wait_hook* hook)
+{
+	pthread_once(&wait_hook_once, wait_hook_init);
+	pthread_setspecific(wait_hook_key, hook);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+#if MIN11_HAS_FIBERS
+
+struct min11::detail::fiber_context
+{
+	ucontext_t context;
+	void* stack; // mapping including the guard page; null for a thread
+	size_t mapped;
+	void (*entry)(void*);
+	void* arg;
+#if defined(MIN11_TSAN_FIBERS)
+	void* tsan; // ThreadSanitizer's state for the context's stack
+#endif
+};
+
+// makecontext only passes int arguments: the context arrives in halves
+static void fiber_start(unsigned int low, unsigned int high)
+{
+	const unsigned long long bits = (static_cast<unsigned long long>(high) << 32) | low;
+	fiber_context* context = reinterpret_cast<fiber_context*>(static_cast<uintptr_t>(bits));
+	context->entry(context->arg);
+
+	// entry switches away for good instead of returning
+	abort();
+}
+
+fiber_context* min11::detail::create_fiber_context(void (*entry)(void*), void* arg, size_t stack_size)
+{
+	// nothing computed here is modified after getcontext, which may
+	// return twice
+	const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t rounded = (stack_size + page - 1) / page * page;
+
+	// one inaccessible page below the stack turns an overflow into a
+	// fault rather than silent corruption
+	const size_t mapped = rounded + page;
+	void* stack = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (stack == MAP_FAILED)
+		return NULL;
+	mprotect(stack, page, PROT_NONE);
+
+	fiber_context* context = new fiber_context;
+	context->stack = stack;
+	context->mapped = mapped;
+	context->entry = entry;
+	context->arg = arg;
+
+	if (0 != getcontext(&context->context))
+	{
+		munmap(stack, mapped);
+		delete context;
+		return NULL;
+	}
+
+	context->context.uc_stack.ss_sp = static_cast<char*>(stack) + page;
+	context->context.uc_stack.ss_size = rounded;
+	context->context.uc_link = NULL;
+
+	const unsigned long long bits = reinterpret_cast<uintptr_t>(context);
+	makecontext(&context->context, reinterpret_cast<void (*)()>(&fiber_start), 2,
+		static_cast<unsigned int>(bits), static_cast<unsigned int>(bits >> 32));
+#if defined(MIN11_TSAN_FIBERS)
+	context->tsan = __tsan_create_fiber(0);
+#endif
+	return context;
+}
+
+void min11::detail::destroy_fiber_context(fiber_context* context)
+{
+#if defined(MIN11_TSAN_FIBERS)
+	__tsan_destroy_fiber(context->tsan);
+#endif
+	munmap(context->stack, context->mapped);
+	delete context;
+}
+
+fiber_context* min11::detail::convert_thread_to_fiber()
+{
+	fiber_context* context = new fiber_context;
+	context->stack = NULL;
+	context->mapped = 0;
+	context->entry = NULL;
+	context->arg = NULL;
+#if defined(MIN11_TSAN_FIBERS)
+	context->tsan = __tsan_get_current_fiber();
+#endif
+	return context;
+}
+
+void min11::detail::release_thread_fiber(fiber_context* context)
+{
+	delete context;
+}
+
+void min11::detail::switch_fiber_context(fiber_context* from, fiber_context* to)
+{
+#if defined(MIN11_TSAN_FIBERS)
+	// tell ThreadSanitizer about the stack switch, and that the
+	// resumed fiber continues from whatever preceded it here
+	__tsan_switch_to_fiber(to->tsan, 0);
+#endif
+	swapcontext(&from->context, &to->context);
+}
+
+#endif // MIN11_HAS_FIBERS
+
+///////////////////////////////////////////////////////////////////////////////
+
+#if MIN11_HAS_IO_REACTOR
+
+enum io_kind
+{
+	io_read,
+	io_write,
+	io_accept
+};
+
+struct io_operation
+{
+	io_operation* next;
+	io_kind kind;
+	void* buf;
+	size_t size;
+	bool socket;
+	unsigned long epoch;
+	promise<io_result> result;
+};
+
+// per-descriptor state. Queue [0] holds reads and accepts, [1] writes.
+// What was learnt about the open file is kept until cancel(), which the
+// caller must make before closing the number.
+enum io_file_state
+{
+	io_file_unknown,
+	io_file_plain,
+	io_file_socket
+};
+
+struct io_descriptor
+{
+	int fd;
+	volatile long file;
+	volatile long pending[2];
+	bool registered;
+	bool dispatching;
+	unsigned long epoch;
+	io_operation* head[2];
+	io_operation* tail[2];
+};
+
+typedef io_descriptor* io_slot;
+
+enum
+{
+	io_chunk_size = 1024,
+	io_chunk_count = 1024
+};
+
+struct min11::detail::io_reactor_internal
+{
+	int epoll_fd;
+	int wake_fd;
+	volatile long stopping;
+	pthread_mutex_t lock;
+
+	// descriptors indexed by fd, read without the lock
+	io_slot* volatile chunks[io_chunk_count];
+};
+
+static void complete_operation(io_operation* op, const io_result& result)
+{
+	op->result.set_value(result);
+	delete op;
+}
+
+static void fail_operations(io_descriptor* d, int dir, io_operation* list, int error)
+{
+	io_result result;
+	result.error = error;
+	while (list)
+	{
+		io_operation* next = list->next;
+		complete_operation(list, result);
+		atomic_fetch_add(&d->pending[dir], -1);
+		list = next;
+	}
+}
+
+// switch the file to non-blocking mode the first time it is used.
+// Returns whether it is a socket.
+static bool prepare_descriptor(io_descriptor* d)
+{
+	long file = atomic_load(&d->file);
+	if (file == io_file_unknown)
+	{
+		// racing threads probe the same file and agree on the result
+		const int flags = fcntl(d->fd, F_GETFL);
+		if (flags != -1 && !(flags & O_NONBLOCK))
+			fcntl(d->fd, F_SETFL, flags | O_NONBLOCK);
+
+		struct stat st;
+		const bool socket = (0 == fstat(d->fd, &st) && S_ISSOCK(st.st_mode));
+		file = socket ? io_file_socket : io_file_plain;
+		atomic_store(&d->file, file);
+	}
+
+	return file == io_file_socket;
+}
+
+// perform an operation without blocking. Returns false if it would block
+static bool attempt_operation(int fd, io_kind kind, void* buf, size_t size, bool socket, io_result* result)
+{
+	for (;;)
+	{
+		ssize_t n;
+		switch (kind)
+		{
+		case io_read:
+			n = read(fd, buf, size);
+			break;
+		case io_write:
+			// keep a closed peer from raising SIGPIPE
+			n = socket ? send(fd, buf, size, MSG_NOSIGNAL) : write(fd, buf, size);
+			break;
+		default:
+			n = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (n >= 0)
+			{
+				result->fd = static_cast<int>(n);
+				n = 0;
+			}
+			break;
+		}
+
+		if (n >= 0)
+		{
+			result->bytes = static_cast<size_t>(n);
+			return true;
+		}
+
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return false;
+
+		result->error = errno;
+		return true;
+	}
+}
+
+static io_descriptor* find_descriptor(io_reactor_internal* r, int fd, bool create)
+{
+	if (fd < 0 || fd >= io_chunk_size * io_chunk_count)
+		return NULL;
+
+	io_slot* chunk = atomic_load(&r->chunks[fd / io_chunk_size]);
+	if (chunk)
+	{
+		io_descriptor* d = atomic_load(&chunk[fd % io_chunk_size]);
+		if (d)
+			return d;
+	}
+
+	if (!create)
+		return NULL;
+
+	pthread_mutex_lock(&r->lock);
+	chunk = r->chunks[fd / io_chunk_size];
+	if (!chunk)
+	{
+		chunk = new io_slot[io_chunk_size];
+		for (int ii = 0; ii < io_chunk_size; ++ii)
+			chunk[ii] = NULL;
+		atomic_store(&r->chunks[fd / io_chunk_size], chunk);
+	}
+
+	io_descriptor* d = chunk[fd % io_chunk_size];
+	if (!d)
+	{
+		d = new io_descriptor;
+		d->fd = fd;
+		d->file = io_file_unknown;
+		d->pending[0] = 0;
+		d->pending[1] = 0;
+		d->registered = false;
+		d->dispatching = false;
+		d->epoch = 0;
+		d->head[0] = d->head[1] = NULL;
+		d->tail[0] = d->tail[1] = NULL;
+		atomic_store(&chunk[fd % io_chunk_size], d);
+	}
+
+	pthread_mutex_unlock(&r->lock);
+	return d;
+}
+
+// watch the descriptor for its queued operations. Called with the lock
+// held; on failure the queued operations are detached into `failed'.
+static void arm_descriptor(io_reactor_internal* r, io_descriptor* d, io_operation* failed[2], int* error)
+{
+	if (d->dispatching)
+		return;
+
+	epoll_event ev;
+	ev.events = EPOLLONESHOT;
+	ev.data.ptr = d;
+	if (d->head[0])
+		ev.events |= EPOLLIN;
+	if (d->head[1])
+		ev.events |= EPOLLOUT;
+	if (ev.events == EPOLLONESHOT)
+		return;
+
+	// closing a descriptor drops its registration, and a reused number
+	// may already be registered: retry with the other operation
+	int op = d->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	int result = epoll_ctl(r->epoll_fd, op, d->fd, &ev);
+	if (result != 0 && (errno == ENOENT || errno == EEXIST))
+	{
+		op = (errno == ENOENT) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+		result = epoll_ctl(r->epoll_fd, op, d->fd, &ev);
+	}
+
+	if (0 == result)
+	{
+		d->registered = true;
+		return;
+	}
+
+	// e.g. EPERM for a descriptor epoll cannot watch
+	*error = errno;
+	for (int dir = 0; dir < 2; ++dir)
+	{
+		failed[dir] = d->head[dir];
+		d->head[dir] = d->tail[dir] = NULL;
+	}
+}
+
+static io_reactor::result_future ready_result(const io_result& result)
+{
+	promise<io_result> p;
+	p.set_value(result);
+	return p.get_future();
+}
+
+static io_reactor::result_future submit_operation(io_reactor_internal* r, int fd, io_kind kind, void* buf, size_t size)
+{
+	const int dir = (kind == io_write) ? 1 : 0;
+	io_descriptor* d = find_descriptor(r, fd, true);
+	if (!d)
+	{
+		io_result result;
+		result.error = EBADF;
+		return ready_result(result);
+	}
+
+	const bool socket = prepare_descriptor(d);
+
+	// nothing queued ahead of us: try it on this thread first
+	if (0 == atomic_load(&d->pending[dir]))
+	{
+		io_result result;
+		if (attempt_operation(fd, kind, buf, size, socket, &result))
+			return ready_result(result);
+	}
+
+	io_operation* op = new io_operation;
+	op->next = NULL;
+	op->kind = kind;
+	op->buf = buf;
+	op->size = size;
+	op->socket = socket;
+	io_reactor::result_future f = op->result.get_future();
+
+	io_operation* failed[2] = {NULL, NULL};
+	int error = 0;
+
+	pthread_mutex_lock(&r->lock);
+	atomic_fetch_add(&d->pending[dir], 1);
+	op->epoch = d->epoch;
+	if (d->tail[dir])
+		d->tail[dir]->next = op;
+	else
+		d->head[dir] = op;
+	d->tail[dir] = op;
+	arm_descriptor(r, d, failed, &error);
+	pthread_mutex_unlock(&r->lock);
+
+	fail_operations(d, 0, failed[0], error);
+	fail_operations(d, 1, failed[1], error);
+	return f;
+}
+
+// complete queued operations in one direction until one would block
+static size_t dispatch_queue(io_reactor_internal* r, io_descriptor* d, int dir)
+{
+	size_t completed = 0;
+	for (;;)
+	{
+		pthread_mutex_lock(&r->lock);
+		io_operation* op = d->head[dir];
+		if (op)
+		{
+			d->head[dir] = op->next;
+			if (!op->next)
+				d->tail[dir] = NULL;
+		}
+		pthread_mutex_unlock(&r->lock);
+
+		if (!op)
+			break;
+
+		io_result result;
+		if (!attempt_operation(d->fd, op->kind, op->buf, op->size, op->socket, &result))
+		{
+			pthread_mutex_lock(&r->lock);
+			const bool cancelled = (op->epoch != d->epoch);
+			if (!cancelled)
+			{
+				op->next = d->head[dir];
+				d->head[dir] = op;
+				if (!d->tail[dir])
+					d->tail[dir] = op;
+			}
+			pthread_mutex_unlock(&r->lock);
+
+			if (cancelled)
+			{
+				op->next = NULL;
+				fail_operations(d, dir, op, ECANCELED);
+			}
+			break;
+		}
+
+		complete_operation(op, result);
+		atomic_fetch_add(&d->pending[dir], -1);
+		++completed;
+	}
+
+	return completed;
+}
+
+io_reactor::io_reactor()
+	: r(new io_reactor_internal)
+{
+	r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	r->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	r->stopping = 0;
+	for (int ii = 0; ii < io_chunk_count; ++ii)
+		r->chunks[ii] = NULL;
+
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (r->epoll_fd == -1 || r->wake_fd == -1 || 0 != epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->wake_fd, &ev))
+	{
+		if (r->epoll_fd != -1)
+			close(r->epoll_fd);
+		if (r->wake_fd != -1)
+			close(r->wake_fd);
+		delete r;
+
+#if MIN11_HAS_EXCEPTIONS
+		throw io_error("failed to create epoll instance");
+#else
+		MIN11_THROW_EXCEPTION("failed to create epoll instance");
+#endif
+	}
+
+	pthread_mutex_init(&r->lock, NULL);
+}
+
+io_reactor::~io_reactor()
+{
+	for (int ii = 0; ii < io_chunk_count; ++ii)
+	{
+		io_slot* chunk = r->chunks[ii];
+		if (!chunk)
+			continue;
+
+		for (int jj = 0; jj < io_chunk_size; ++jj)
+		{
+			io_descriptor* d = chunk[jj];
+			if (!d)
+				continue;
+
+			fail_operations(d, 0, d->head[0], ECANCELED);
+			fail_operations(d, 1, d->head[1], ECANCELED);
+			delete d;
+		}
+
+		delete[] chunk;
+	}
+
+	close(r->epoll_fd);
+	close(r->wake_fd);
+	pthread_mutex_destroy(&r->lock);
+	delete r;
+}
+
+io_reactor::result_future io_reactor::async_read(int fd, void* buf, size_t size)
+{
+	return submit_operation(r, fd, io_read, buf, size);
+}
+
+io_reactor::result_future io_reactor::async_write(int fd, const void* buf, size_t size)
+{
+	return submit_operation(r, fd, io_write, const_cast<void*>(buf), size);
+}
+
+io_reactor::result_future io_reactor::async_accept(int fd)
+{
+	return submit_operation(r, fd, io_accept, NULL, 0);
+}
+
+void io_reactor::cancel(int fd)
+{
+	io_descriptor* d = find_descriptor(r, fd, false);
+	if (!d)
+		return;
+
+	pthread_mutex_lock(&r->lock);
+	io_operation* cancelled[2] = {d->head[0], d->head[1]};
+	d->head[0] = d->head[1] = NULL;
+	d->tail[0] = d->tail[1] = NULL;
+	++d->epoch;
+	atomic_store(&d->file, static_cast<long>(io_file_unknown));
+	if (d->registered)
+	{
+		epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+		d->registered = false;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	fail_operations(d, 0, cancelled[0], ECANCELED);
+	fail_operations(d, 1, cancelled[1], ECANCELED);
+}
+
+void io_reactor::run()
+{
+	while (!atomic_load(&r->stopping))
+		run_once(-1);
+}
+
+size_t io_reactor::run_once(int timeout_ms)
+{
+	epoll_event events[64];
+	const int count = epoll_wait(r->epoll_fd, events, 64, timeout_ms);
+
+	size_t completed = 0;
+	for (int ii = 0; ii < count; ++ii)
+	{
+		// the wake descriptor is left readable once stopped
+		io_descriptor* d = static_cast<io_descriptor*>(events[ii].data.ptr);
+		if (!d)
+			continue;
+
+		// EPOLLONESHOT hands each readiness to a single thread; keep
+		// submitters from re-arming until this thread is done
+		pthread_mutex_lock(&r->lock);
+		d->dispatching = true;
+		pthread_mutex_unlock(&r->lock);
+
+		const unsigned ready = events[ii].events;
+		if (ready & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			completed += dispatch_queue(r, d, 0);
+		if (ready & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+			completed += dispatch_queue(r, d, 1);
+
+		io_operation* failed[2] = {NULL, NULL};
+		int error = 0;
+
+		pthread_mutex_lock(&r->lock);
+		d->dispatching = false;
+		arm_descriptor(r, d, failed, &error);
+		pthread_mutex_unlock(&r->lock);
+
+		fail_operations(d, 0, failed[0], error);
+		fail_operations(d, 1, failed[1], error);
+	}
+
+	return completed;
+}
+
+void io_reactor::stop()
+{
+	atomic_store(&r->stopping, 1);
+
+	const uint64_t one = 1;
+	while (-1 == write(r->wake_fd, &one, sizeof(one)) && errno == EINTR)
+	{
+	}
+}
+
+#endif // MIN11_HAS_IO_REACTOR
+
+///////////////////////////////////////////////////////////////////////////////
+
+#if MIN11_HAS_INTERPROCESS
+
+struct interprocess_sync
+{
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+};
+
+// lock a process-shared mutex, recovering it if its owner died
+static void lock_interprocess(pthread_mutex_t* mtx)
+{
+	const int err = pthread_mutex_lock(mtx);
+#if defined(__GLIBC__)
+	if (err == EOWNERDEAD)
+		pthread_mutex_consistent(mtx);
+#else
+	(void)err;
+#endif
+}
+
+size_t min11::detail::interprocess_sync_size()
+{
+	return sizeof(interprocess_sync);
+}
+
+void min11::detail::interprocess_sync_init(void* sync)
+{
+	interprocess_sync* s = static_cast<interprocess_sync*>(sync);
+
+	pthread_mutexattr_t mattr;
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+#if defined(__GLIBC__)
+	pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+#endif
+	pthread_mutex_init(&s->mtx, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+
+	pthread_condattr_t cattr;
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	pthread_cond_init(&s->cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+}
+
+void min11::detail::interprocess_sync_wait(void* sync, const volatile long* ready)
+{
+	interprocess_sync* s = static_cast<interprocess_sync*>(sync);
+	lock_interprocess(&s->mtx);
+	while (!atomic_load(ready))
+	{
+		if (EOWNERDEAD == pthread_cond_wait(&s->cond, &s->mtx))
+		{
+#if defined(__GLIBC__)
+			pthread_mutex_consistent(&s->mtx);
+#endif
+		}
+	}
+	pthread_mutex_unlock(&s->mtx);
+}
+
+void min11::detail::interprocess_sync_notify(void* sync, volatile long* ready)
+{
+	interprocess_sync* s = static_cast<interprocess_sync*>(sync);
+	lock_interprocess(&s->mtx);
+	atomic_store(ready, 1);
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->mtx);
+}
+
+// start of every segment
+struct arena_header
+{
+	volatile long initialized;
+	unsigned long size;
+	volatile long next;
+};
+
+static const long arena_magic = 0x6d313161;
+
+struct min11::detail::arena_internal
+{
+	int fd;
+	void* base;
+	size_t size;
+};
+
+static void throw_interprocess_error(const char* message)
+{
+#if MIN11_HAS_EXCEPTIONS
+	throw interprocess_error(message);
+#else
+	MIN11_THROW_EXCEPTION(message);
+#endif
+}
+
+shared_memory_arena::shared_memory_arena(const char* name, size_t size, open_mode mode)
+	: a(new arena_internal)
+{
+	const bool creating = (mode == create_only);
+	a->fd = shm_open(name, creating ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0600);
+	if (a->fd == -1)
+	{
+		delete a;
+		throw_interprocess_error(creating ? "failed to create shared memory segment" : "failed to open shared memory segment");
+	}
+
+	if (creating)
+	{
+		if (size < sizeof(arena_header))
+			size = sizeof(arena_header);
+		if (0 != ftruncate(a->fd, static_cast<off_t>(size)))
+		{
+			close(a->fd);
+			shm_unlink(name);
+			delete a;
+			throw_interprocess_error("failed to size shared memory segment");
+		}
+	}
+	else
+	{
+		struct stat st;
+		if (0 != fstat(a->fd, &st) || static_cast<size_t>(st.st_size) < sizeof(arena_header))
+		{
+			close(a->fd);
+			delete a;
+			throw_interprocess_error("shared memory segment is not an arena");
+		}
+		size = static_cast<size_t>(st.st_size);
+	}
+
+	a->size = size;
+	a->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, a->fd, 0);
+	if (a->base == MAP_FAILED)
+	{
+		close(a->fd);
+		if (creating)
+			shm_unlink(name);
+		delete a;
+		throw_interprocess_error("failed to map shared memory segment");
+	}
+
+	arena_header* header = static_cast<arena_header*>(a->base);
+	if (creating)
+	{
+		header->size = size;
+		header->next = static_cast<long>(interprocess_state::align(sizeof(arena_header)));
+		atomic_store(&header->initialized, arena_magic);
+	}
+	else if (atomic_load(&header->initialized) != arena_magic)
+	{
+		munmap(a->base, a->size);
+		close(a->fd);
+		delete a;
+		throw_interprocess_error("shared memory segment is not an arena");
+	}
+}
+
+shared_memory_arena::~shared_memory_arena()
+{
+	munmap(a->base, a->size);
+	close(a->fd);
+	delete a;
+}
+
+bool shared_memory_arena::remove(const char* name)
+{
+	return 0 == shm_unlink(name);
+}
+
+size_t shared_memory_arena::allocate(size_t bytes)
+{
+	arena_header* header = static_cast<arena_header*>(a->base);
+	bytes = interprocess_state::align(bytes ? bytes : 1);
+
+	long offset = atomic_load(&header->next);
+	for (;;)
+	{
+		if (static_cast<size_t>(offset) + bytes > a->size)
+			return 0;
+
+		const long previous = atomic_compare_exchange(&header->next, offset, offset + static_cast<long>(bytes));
+		if (previous == offset)
+			return static_cast<size_t>(offset);
+		offset = previous;
+	}
+}
+
+void* shared_memory_arena::address(size_t offset) const
+{
+	return static_cast<char*>(a->base) + offset;
+}
+
+size_t shared_memory_arena::size() const
+{
+	return a->size;
+}
+
+#endif // MIN11_HAS_INTERPROCESS
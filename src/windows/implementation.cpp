@@ -26,12 +26,25 @@
 
 #include "min11/mutex.h"
 #include "min11/condition_variable.h"
+#include "min11/atomic.h"
 #include "min11/atomic_counter.h"
+#include "min11/fiber.h"
+#include "min11/future.h"
+#include "min11/queue_lock.h"
+#include "min11/thread.h"
+#include "min11/thread_specific_ptr.h"
+#include "min11/timer_service.h"
+
+#if MIN11_HAS_PARKING_LOT
+#	error MIN11_HAS_PARKING_LOT is only implemented by the pthreads backend
+#endif
 
 #if !defined(_DURANGO)
 #define WIN32_LEAN_AND_MEAN
 #endif
 #include <Windows.h>
+#include <process.h>
+#include <string.h>
 
 using namespace min11;
 using namespace min11::detail;
@@ -55,6 +68,9 @@ mutex::~mutex()
 
 void mutex::lock()
 {
+	if (TRUE == TryEnterCriticalSection(&m->cs) || lock_as_fiber(this))
+		return;
+
 	EnterCriticalSection(&m->cs);
 }
 
@@ -70,6 +86,41 @@ void mutex::unlock()
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Windows offers no priority-inheritance protocol; the scheduler's boost of
+// starved ready threads is the nearest equivalent, so pi_mutex is a plain
+// critical section here.
+pi_mutex::pi_mutex()
+	: m(new mutex_internal)
+{
+	InitializeCriticalSection(&m->cs);
+}
+
+pi_mutex::~pi_mutex()
+{
+	DeleteCriticalSection(&m->cs);
+	delete m;
+}
+
+void pi_mutex::lock()
+{
+	if (TRUE == TryEnterCriticalSection(&m->cs) || lock_as_fiber(this))
+		return;
+
+	EnterCriticalSection(&m->cs);
+}
+
+bool pi_mutex::try_lock()
+{
+	return TRUE == TryEnterCriticalSection(&m->cs);
+}
+
+void pi_mutex::unlock()
+{
+	LeaveCriticalSection(&m->cs);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 struct min11::detail::condition_variable_internal
 {
 	CONDITION_VARIABLE cv;
@@ -77,6 +128,7 @@ struct min11::detail::condition_variable_internal
 
 condition_variable::condition_variable()
 	: cv(new condition_variable_internal)
+	, fibers(NULL)
 {
 	InitializeConditionVariable(&cv->cv);
 }
@@ -84,20 +136,46 @@ condition_variable::condition_variable()
 condition_variable::~condition_variable()
 {
 	delete cv;
+	delete fibers;
 }
 
 void condition_variable::wait(unique_lock<mutex>& lock)
 {
-	SleepConditionVariableCS(&cv->cv, &lock.mutex()->m->cs, INFINITE);
+	if (!wait_as_fiber(&fibers, lock.mutex()))
+		SleepConditionVariableCS(&cv->cv, &lock.mutex()->m->cs, INFINITE);
+}
+
+void condition_variable::wait(unique_lock<pi_mutex>& lock)
+{
+	if (!wait_as_fiber(&fibers, lock.mutex()))
+		SleepConditionVariableCS(&cv->cv, &lock.mutex()->m->cs, INFINITE);
+}
+
+// INFINITE would never time out
+static DWORD wait_timeout(unsigned long ms)
+{
+	return (ms < INFINITE) ? static_cast<DWORD>(ms) : INFINITE - 1;
+}
+
+bool condition_variable::wait_for(unique_lock<mutex>& lock, unsigned long ms)
+{
+	return FALSE != SleepConditionVariableCS(&cv->cv, &lock.mutex()->m->cs, wait_timeout(ms));
+}
+
+bool condition_variable::wait_for(unique_lock<pi_mutex>& lock, unsigned long ms)
+{
+	return FALSE != SleepConditionVariableCS(&cv->cv, &lock.mutex()->m->cs, wait_timeout(ms));
 }
 
 void condition_variable::notify_one()
 {
-	WakeConditionVariable(&cv->cv);
+	if (!notify_fibers(&fibers, false))
+		WakeConditionVariable(&cv->cv);
 }
 
 void condition_variable::notify_all()
 {
+	notify_fibers(&fibers, true);
 	WakeAllConditionVariable(&cv->cv);
 }
 
@@ -117,3 +195,691 @@ long atomic_counter::decr()
 {
 	return InterlockedDecrement(&value);
 }
+
+///////////////////////////////////////////////////////////////////////////////
+
+long min11::detail::atomic_load(const volatile long* p)
+{
+	long value = *p;
+	MemoryBarrier();
+	return value;
+}
+
+void min11::detail::atomic_store(volatile long* p, long value)
+{
+	InterlockedExchange(const_cast<long*>(p), value);
+}
+
+long min11::detail::atomic_exchange(volatile long* p, long value)
+{
+	return InterlockedExchange(const_cast<long*>(p), value);
+}
+
+long min11::detail::atomic_compare_exchange(volatile long* p, long expected, long desired)
+{
+	return InterlockedCompareExchange(const_cast<long*>(p), desired, expected);
+}
+
+long min11::detail::atomic_fetch_add(volatile long* p, long delta)
+{
+	return InterlockedExchangeAdd(const_cast<long*>(p), delta);
+}
+
+void* min11::detail::atomic_load_ptr(void* const volatile* p)
+{
+	void* value = *p;
+	MemoryBarrier();
+	return value;
+}
+
+void min11::detail::atomic_store_ptr(void* volatile* p, void* value)
+{
+	InterlockedExchangePointer(const_cast<void**>(p), value);
+}
+
+void* min11::detail::atomic_exchange_ptr(void* volatile* p, void* value)
+{
+	return InterlockedExchangePointer(const_cast<void**>(p), value);
+}
+
+void* min11::detail::atomic_compare_exchange_ptr(void* volatile* p, void* expected, void* desired)
+{
+	return InterlockedCompareExchangePointer(const_cast<void**>(p), desired, expected);
+}
+
+void min11::detail::atomic_fence()
+{
+	MemoryBarrier();
+}
+
+void min11::detail::cpu_relax()
+{
+	YieldProcessor();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct min11::detail::thread_internal
+{
+	HANDLE thread;
+	unsigned long id;
+};
+
+// owned by the new thread, so it stays valid after a detach
+struct thread_launch
+{
+	void (*entry)(void*);
+	void* arg;
+	char name[64];
+};
+
+typedef HRESULT (WINAPI *set_thread_description_fn)(HANDLE, PCWSTR);
+
+// SetThreadDescription is only available from Windows 10 1607
+static void set_thread_name(const char* name)
+{
+	HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+	if (!kernel)
+		return;
+
+	set_thread_description_fn set_description = reinterpret_cast<set_thread_description_fn>(GetProcAddress(kernel, "SetThreadDescription"));
+	if (!set_description)
+		return;
+
+	WCHAR wide[64];
+	if (0 != MultiByteToWideChar(CP_UTF8, 0, name, -1, wide, 64))
+		set_description(GetCurrentThread(), wide);
+}
+
+static unsigned __stdcall thread_entry(void* arg)
+{
+	thread_launch* launch = static_cast<thread_launch*>(arg);
+	if (launch->name[0])
+		set_thread_name(launch->name);
+
+	void (*entry)(void*) = launch->entry;
+	void* entry_arg = launch->arg;
+	delete launch;
+
+	entry(entry_arg);
+	tls_thread_exit();
+	return 0;
+}
+
+static int thread_priority(const thread_attributes& attr)
+{
+	switch (attr.scheduling())
+	{
+	case thread_attributes::sched_fifo:
+	case thread_attributes::sched_round_robin:
+		return THREAD_PRIORITY_TIME_CRITICAL;
+	case thread_attributes::sched_batch:
+		return THREAD_PRIORITY_BELOW_NORMAL;
+	case thread_attributes::sched_idle:
+		return THREAD_PRIORITY_IDLE;
+	default:
+		return THREAD_PRIORITY_NORMAL;
+	}
+}
+
+thread_internal* min11::detail::create_thread(void (*entry)(void*), void* arg, const thread_attributes* attr)
+{
+	thread_launch* launch = new thread_launch;
+	launch->entry = entry;
+	launch->arg = arg;
+	launch->name[0] = '\0';
+	if (attr)
+		memcpy(launch->name, attr->name(), sizeof(launch->name));
+
+	thread_internal* t = new thread_internal;
+	unsigned id;
+	const unsigned stack = attr ? static_cast<unsigned>(attr->stack_size()) : 0;
+	t->thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL, stack, thread_entry, launch, CREATE_SUSPENDED | STACK_SIZE_PARAM_IS_A_RESERVATION, &id));
+	t->id = id;
+	if (!t->thread)
+	{
+		delete launch;
+		delete t;
+		return NULL;
+	}
+
+	if (attr)
+	{
+		if (attr->has_affinity())
+		{
+			DWORD_PTR mask = 0;
+			for (unsigned cpu = 0; cpu < sizeof(mask) * 8; ++cpu)
+			{
+				if (attr->has_cpu(cpu))
+					mask |= static_cast<DWORD_PTR>(1) << cpu;
+			}
+			SetThreadAffinityMask(t->thread, mask);
+		}
+
+		if (attr->scheduling() != thread_attributes::sched_default)
+			SetThreadPriority(t->thread, thread_priority(*attr));
+	}
+
+	ResumeThread(t->thread);
+	return t;
+}
+
+void min11::detail::join_thread(thread_internal* t)
+{
+	WaitForSingleObject(t->thread, INFINITE);
+	CloseHandle(t->thread);
+	delete t;
+}
+
+void min11::detail::detach_thread(thread_internal* t)
+{
+	CloseHandle(t->thread);
+	delete t;
+}
+
+unsigned long min11::detail::thread_id(const thread_internal* t)
+{
+	return t->id;
+}
+
+unsigned min11::detail::hardware_concurrency()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
+unsigned long min11::detail::current_thread_id()
+{
+	return GetCurrentThreadId();
+}
+
+void min11::detail::yield_thread()
+{
+	SwitchToThread();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long long min11::detail::monotonic_milliseconds()
+{
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	// split to keep counter * 1000 from overflowing
+	const unsigned long long ticks = static_cast<unsigned long long>(counter.QuadPart);
+	const unsigned long long rate = static_cast<unsigned long long>(frequency.QuadPart);
+	return (ticks / rate) * 1000 + (ticks % rate) * 1000 / rate;
+}
+
+void min11::detail::sleep_milliseconds(unsigned long ms)
+{
+	Sleep(ms);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct tls_entry
+{
+	void (*cleanup)(void*, void*);
+	void* context;
+	bool used;
+};
+
+// table operations are rare (slot allocation, a thread's first value,
+// thread exit) and need a lock usable before any constructor has run
+static volatile long tls_lock_word;
+static tls_entry* tls_entries;
+static size_t tls_nentries;
+static tls_block* tls_blocks; // every thread holding a table
+
+static void tls_lock()
+{
+	while (0 != atomic_compare_exchange(&tls_lock_word, 0, 1))
+		yield_thread();
+}
+
+static void tls_unlock()
+{
+	atomic_store(&tls_lock_word, 0);
+}
+
+typedef void (WINAPI *fls_callback_fn)(void*);
+typedef DWORD (WINAPI *fls_alloc_fn)(fls_callback_fn);
+typedef BOOL (WINAPI *fls_set_value_fn)(DWORD, void*);
+
+// FlsAlloc callbacks run at thread exit for every thread, not only those
+// started by min11::thread. Fiber local storage is only available from
+// Windows Vista.
+static DWORD tls_exit_index;
+static fls_set_value_fn tls_set_exit_value;
+static volatile long tls_initialized;
+
+#if MIN11_HAS_COMPILER_TLS
+MIN11_THREAD_LOCAL tls_block min11::detail::tls_current;
+
+static tls_block* current_block(bool)
+{
+	return &tls_current;
+}
+#else
+static DWORD tls_index;
+
+static tls_block* current_block(bool create)
+{
+	tls_block* block = static_cast<tls_block*>(TlsGetValue(tls_index));
+	if (!block && create)
+	{
+		block = new tls_block;
+		block->slots = NULL;
+		block->size = 0;
+		block->next = NULL;
+		block->prev = NULL;
+		TlsSetValue(tls_index, block);
+	}
+	return block;
+}
+
+void* min11::detail::tls_get(size_t slot)
+{
+	const tls_block* block = static_cast<tls_block*>(TlsGetValue(tls_index));
+	return (block && slot < block->size) ? block->slots[slot] : NULL;
+}
+#endif
+
+static void release_block(tls_block* block)
+{
+	if (!block || !block->slots)
+		return;
+
+	// cleanup functions may set values of their own; make a few passes,
+	// as pthreads does for key destructors
+	for (int pass = 0; pass < 4; ++pass)
+	{
+		bool ran = false;
+		for (size_t ii = 0; ii < block->size; ++ii)
+		{
+			void* value = block->slots[ii];
+			if (!value)
+				continue;
+
+			block->slots[ii] = NULL;
+
+			tls_lock();
+			const tls_entry entry = tls_entries[ii];
+			tls_unlock();
+
+			if (entry.used)
+				entry.cleanup(entry.context, value);
+			ran = true;
+		}
+
+		if (!ran)
+			break;
+	}
+
+	tls_lock();
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		tls_blocks = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+	void** slots = block->slots;
+	block->slots = NULL;
+	block->size = 0;
+	block->next = NULL;
+	block->prev = NULL;
+	tls_unlock();
+
+	delete[] slots;
+#if !MIN11_HAS_COMPILER_TLS
+	delete block;
+#endif
+}
+
+static void WINAPI tls_exit_callback(void* block)
+{
+	release_block(static_cast<tls_block*>(block));
+}
+
+// called with tls_lock held
+static void tls_init()
+{
+#if !MIN11_HAS_COMPILER_TLS
+	tls_index = TlsAlloc();
+#endif
+
+	HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+	if (kernel)
+	{
+		fls_alloc_fn fls_alloc = reinterpret_cast<fls_alloc_fn>(GetProcAddress(kernel, "FlsAlloc"));
+		fls_set_value_fn fls_set_value = reinterpret_cast<fls_set_value_fn>(GetProcAddress(kernel, "FlsSetValue"));
+		if (fls_alloc && fls_set_value)
+		{
+			tls_exit_index = fls_alloc(tls_exit_callback);
+			if (tls_exit_index != 0xFFFFFFFF)
+				tls_set_exit_value = fls_set_value;
+		}
+	}
+
+	atomic_store(&tls_initialized, 1);
+}
+
+size_t min11::detail::tls_allocate(void (*cleanup)(void*, void*), void* context)
+{
+	tls_lock();
+	if (!tls_initialized)
+		tls_init();
+
+	size_t slot = 0;
+	while (slot < tls_nentries && tls_entries[slot].used)
+		++slot;
+
+	if (slot == tls_nentries)
+	{
+		const size_t count = tls_nentries ? tls_nentries * 2 : 16;
+		tls_entry* entries = new tls_entry[count];
+		for (size_t ii = 0; ii < count; ++ii)
+		{
+			if (ii < tls_nentries)
+				entries[ii] = tls_entries[ii];
+			else
+				entries[ii].used = false;
+		}
+
+		delete[] tls_entries;
+		tls_entries = entries;
+		tls_nentries = count;
+	}
+
+	tls_entries[slot].cleanup = cleanup;
+	tls_entries[slot].context = context;
+	tls_entries[slot].used = true;
+	tls_unlock();
+	return slot;
+}
+
+void min11::detail::tls_free(size_t slot)
+{
+	tls_lock();
+	tls_entries[slot].used = false;
+	for (tls_block* block = tls_blocks; block; block = block->next)
+	{
+		if (slot < block->size)
+			block->slots[slot] = NULL;
+	}
+	tls_unlock();
+}
+
+void min11::detail::tls_set(size_t slot, void* value)
+{
+	tls_block* block = current_block(value != NULL);
+	if (!block)
+		return;
+
+	if (slot >= block->size)
+	{
+		if (!value)
+			return;
+
+		size_t size = block->size ? block->size * 2 : 16;
+		while (size <= slot)
+			size *= 2;
+
+		void** slots = new void*[size];
+		for (size_t ii = 0; ii < size; ++ii)
+			slots[ii] = (ii < block->size) ? block->slots[ii] : NULL;
+
+		// swap tables under the lock so tls_free never walks a
+		// table that is being released
+		tls_lock();
+		void** old = block->slots;
+		if (!old)
+		{
+			block->prev = NULL;
+			block->next = tls_blocks;
+			if (tls_blocks)
+				tls_blocks->prev = block;
+			tls_blocks = block;
+		}
+		block->slots = slots;
+		block->size = size;
+		tls_unlock();
+
+		if (old)
+			delete[] old;
+		else if (tls_set_exit_value)
+			tls_set_exit_value(tls_exit_index, block);
+	}
+
+	block->slots[slot] = value;
+}
+
+void min11::detail::tls_thread_exit()
+{
+	if (!atomic_load(&tls_initialized))
+		return;
+
+	tls_block* block = current_block(false);
+	if (block && block->slots)
+	{
+		if (tls_set_exit_value)
+			tls_set_exit_value(tls_exit_index, NULL);
+#if !MIN11_HAS_COMPILER_TLS
+		TlsSetValue(tls_index, NULL);
+#endif
+		release_block(block);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void free_mcs_nodes(mcs_node* node)
+{
+	while (node)
+	{
+		mcs_node* next = node->free_next;
+		delete node;
+		node = next;
+	}
+}
+
+// Per-thread free list of queue entries. An mcs_lock may be used from
+// static constructors and destructors, so the list lives in storage
+// needing no constructor; a fiber-local slot frees it at thread exit
+// where FLS is available. Without compiler TLS no list is kept.
+#if MIN11_HAS_COMPILER_TLS
+static MIN11_THREAD_LOCAL mcs_node* mcs_free_head;
+static MIN11_THREAD_LOCAL bool mcs_exit_armed;
+static volatile long mcs_exit_state; // 0 until looked up, then 1
+static DWORD mcs_exit_index;
+static fls_set_value_fn mcs_set_exit_value;
+
+// the slot's value is the exiting thread's list head
+static void WINAPI mcs_thread_exit(void* head)
+{
+	// also called when a fiber is deleted, possibly by another thread
+	if (head != &mcs_free_head)
+		return;
+
+	free_mcs_nodes(mcs_free_head);
+	mcs_free_head = NULL;
+	mcs_exit_armed = false;
+}
+
+static void arm_mcs_exit()
+{
+	if (!atomic_load(&mcs_exit_state))
+	{
+		tls_lock();
+		if (!mcs_exit_state)
+		{
+			HMODULE kernel = GetModuleHandleW(L"kernel32.dll");
+			if (kernel)
+			{
+				fls_alloc_fn fls_alloc = reinterpret_cast<fls_alloc_fn>(GetProcAddress(kernel, "FlsAlloc"));
+				fls_set_value_fn fls_set_value = reinterpret_cast<fls_set_value_fn>(GetProcAddress(kernel, "FlsSetValue"));
+				if (fls_alloc && fls_set_value)
+				{
+					mcs_exit_index = fls_alloc(mcs_thread_exit);
+					if (mcs_exit_index != 0xFFFFFFFF)
+						mcs_set_exit_value = fls_set_value;
+				}
+			}
+
+			atomic_store(&mcs_exit_state, 1);
+		}
+		tls_unlock();
+	}
+
+	if (mcs_set_exit_value)
+		mcs_set_exit_value(mcs_exit_index, &mcs_free_head);
+	mcs_exit_armed = true;
+}
+
+mcs_node* min11::detail::acquire_mcs_node()
+{
+	mcs_node* node = mcs_free_head;
+	if (!node)
+		return new mcs_node;
+
+	mcs_free_head = node->free_next;
+	return node;
+}
+
+void min11::detail::release_mcs_node(mcs_node* node)
+{
+	if (!mcs_exit_armed)
+		arm_mcs_exit();
+
+	node->free_next = mcs_free_head;
+	mcs_free_head = node;
+}
+#else
+mcs_node* min11::detail::acquire_mcs_node()
+{
+	return new mcs_node;
+}
+
+void min11::detail::release_mcs_node(mcs_node* node)
+{
+	delete node;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Hooks are owned by whoever installs them. Read by every contended wait,
+// so kept in storage needing no constructor: it is valid before this
+// file's static initialisers run and after its static destructors.
+#if MIN11_HAS_COMPILER_TLS
+static MIN11_THREAD_LOCAL wait_hook* wait_hook_current;
+
+wait_hook* min11::detail::current_wait_hook()
+{
+	return wait_hook_current;
+}
+
+void min11::detail::set_current_wait_hook(wait_hook* hook)
+{
+	wait_hook_current = hook;
+}
+#else
+static volatile long wait_hook_slot; // TLS index + 1, 0 until allocated
+
+static DWORD wait_hook_index()
+{
+	long slot = atomic_load(&wait_hook_slot);
+	if (!slot)
+	{
+		const DWORD index = TlsAlloc();
+		slot = atomic_compare_exchange(&wait_hook_slot, 0, static_cast<long>(index) + 1);
+		if (slot)
+			TlsFree(index);
+		else
+			slot = static_cast<long>(index) + 1;
+	}
+
+	return static_cast<DWORD>(slot - 1);
+}
+
+wait_hook* min11::detail::current_wait_hook()
+{
+	return static_cast<wait_hook*>(TlsGetValue(wait_hook_index()));
+}
+
+void min11::detail::set_current_wait_hook(wait_hook* hook)
+{
+	TlsSetValue(wait_hook_index(), hook);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+#if MIN11_HAS_FIBERS
+
+struct min11::detail::fiber_context
+{
+	LPVOID fiber;
+	bool converted; // thread converted by convert_thread_to_fiber
+	void (*entry)(void*);
+	void* arg;
+};
+
+static VOID CALLBACK fiber_start(LPVOID param)
+{
+	fiber_context* context = static_cast<fiber_context*>(param);
+	context->entry(context->arg);
+}
+
+fiber_context* min11::detail::create_fiber_context(void (*entry)(void*), void* arg, size_t stack_size)
+{
+	fiber_context* context = new fiber_context;
+	context->converted = false;
+	context->entry = entry;
+	context->arg = arg;
+	context->fiber = CreateFiber(stack_size, &fiber_start, context);
+	if (!context->fiber)
+	{
+		delete context;
+		return NULL;
+	}
+
+	return context;
+}
+
+void min11::detail::destroy_fiber_context(fiber_context* context)
+{
+	DeleteFiber(context->fiber);
+	delete context;
+}
+
+fiber_context* min11::detail::convert_thread_to_fiber()
+{
+	fiber_context* context = new fiber_context;
+	context->entry = NULL;
+	context->arg = NULL;
+	context->fiber = ConvertThreadToFiber(NULL);
+	context->converted = (context->fiber != NULL);
+
+	// the thread may already be running as a fiber
+	if (!context->fiber)
+		context->fiber = GetCurrentFiber();
+	return context;
+}
+
+void min11::detail::release_thread_fiber(fiber_context* context)
+{
+	if (context->converted)
+		ConvertFiberToThread();
+	delete context;
+}
+
+void min11::detail::switch_fiber_context(fiber_context*, fiber_context* to)
+{
+	SwitchToFiber(to->fiber);
+}
+
+#endif // MIN11_HAS_FIBERS
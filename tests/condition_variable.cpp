@@ -0,0 +1,85 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/condition_variable.h>
+#include <min11/mutex.h>
+#include <min11/thread.h>
+
+namespace
+{
+	struct shared
+	{
+		min11::mutex mtx;
+		min11::condition_variable cond;
+		bool flag;
+	};
+
+	struct set_flag
+	{
+		shared* s;
+
+		void operator()() const
+		{
+			min11::detail::sleep_milliseconds(20);
+			min11::unique_lock<min11::mutex> lock(s->mtx);
+			s->flag = true;
+			s->cond.notify_one();
+		}
+	};
+}
+
+int main()
+{
+	shared s;
+	s.flag = false;
+
+	// nobody notifies: the wait times out, no earlier than asked
+	{
+		min11::unique_lock<min11::mutex> lock(s.mtx);
+		const unsigned long long start = min11::detail::monotonic_milliseconds();
+		CHECK(!s.cond.wait_for(lock, 50));
+		CHECK(min11::detail::monotonic_milliseconds() - start >= 49);
+	}
+
+	// a notify ends the wait well before the timeout
+	{
+		set_flag body = {&s};
+		min11::thread setter(body);
+
+		const unsigned long long start = min11::detail::monotonic_milliseconds();
+		{
+			min11::unique_lock<min11::mutex> lock(s.mtx);
+			while (!s.flag)
+				s.cond.wait_for(lock, 10000);
+		}
+		CHECK(min11::detail::monotonic_milliseconds() - start < 5000);
+		setter.join();
+	}
+
+	return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/epoch_domain.h>
+#include <min11/thread.h>
+
+namespace
+{
+	enum
+	{
+		swaps_per_writer = 20000,
+		node_count = 2 * swaps_per_writer + 1
+	};
+
+	// nodes are never returned to the heap, so a reader can check
+	// whether one was reclaimed under it
+	struct node
+	{
+		volatile long freed;
+	};
+
+	node nodes[node_count];
+	volatile long freed_count;
+
+	void free_node(void* object)
+	{
+		node* n = static_cast<node*>(object);
+		CHECK(0 == min11::detail::atomic_exchange(&n->freed, 1));
+		min11::detail::atomic_fetch_add(&freed_count, 1);
+	}
+
+	struct shared
+	{
+		min11::epoch_domain* domain;
+		node* volatile current;
+		volatile long next_node;
+		volatile long writers_left;
+		volatile long ok;
+	};
+
+	// replace the current node and retire the old one
+	struct writer
+	{
+		shared* s;
+
+		void operator()() const
+		{
+			for (int ii = 0; ii < swaps_per_writer; ++ii)
+			{
+				node* n = &nodes[min11::detail::atomic_fetch_add(&s->next_node, 1)];
+				node* old = min11::detail::atomic_exchange(&s->current, n);
+				s->domain->retire(old, &free_node);
+			}
+
+			min11::detail::atomic_fetch_add(&s->writers_left, -1);
+		}
+	};
+
+	// the node read inside a critical section is never reclaimed under it
+	struct reader
+	{
+		shared* s;
+
+		void operator()() const
+		{
+			while (min11::detail::atomic_load(&s->writers_left))
+			{
+				min11::epoch_domain::guard g(*s->domain);
+				node* n = min11::detail::atomic_load(&s->current);
+				if (min11::detail::atomic_load(&n->freed))
+					min11::detail::atomic_store(&s->ok, 0);
+			}
+		}
+	};
+
+	// park inside a critical section until told to leave
+	struct parked_reader
+	{
+		min11::epoch_domain* domain;
+		volatile long* entered;
+		volatile long* release;
+
+		void operator()() const
+		{
+			min11::epoch_domain::guard g(*domain);
+			min11::detail::atomic_store(entered, 1);
+			while (!min11::detail::atomic_load(release))
+				min11::this_thread::yield();
+		}
+	};
+
+	// retire one node and exit without reclaiming it
+	struct retire_and_exit
+	{
+		min11::epoch_domain* domain;
+		node* n;
+
+		void operator()() const
+		{
+			domain->retire(n, &free_node);
+		}
+	};
+
+	// reclaim on a fresh thread, which adopts the exited thread's record
+	struct reclaim_thrice
+	{
+		min11::epoch_domain* domain;
+
+		void operator()() const
+		{
+			for (int ii = 0; ii < 3; ++ii)
+				domain->reclaim();
+		}
+	};
+}
+
+int main()
+{
+	// retired objects are freed once two epochs pass
+	{
+		min11::epoch_domain domain;
+		min11::detail::atomic_store(&freed_count, 0);
+		for (int ii = 0; ii < 10; ++ii)
+			domain.retire(&nodes[ii], &free_node);
+		CHECK(0 == min11::detail::atomic_load(&freed_count));
+
+		for (int ii = 0; ii < 3; ++ii)
+			domain.reclaim();
+		CHECK(10 == min11::detail::atomic_load(&freed_count));
+	}
+
+	// a thread inside a critical section holds back reclamation
+	{
+		min11::epoch_domain domain;
+		min11::detail::atomic_store(&freed_count, 0);
+		for (int ii = 0; ii < 10; ++ii)
+			min11::detail::atomic_store(&nodes[ii].freed, 0);
+
+		volatile long entered = 0;
+		volatile long release = 0;
+		parked_reader p = {&domain, &entered, &release};
+		min11::thread parked(p);
+		while (!min11::detail::atomic_load(&entered))
+			min11::this_thread::yield();
+
+		for (int ii = 0; ii < 10; ++ii)
+			domain.retire(&nodes[ii], &free_node);
+		for (int ii = 0; ii < 10; ++ii)
+			domain.reclaim();
+		CHECK(0 == min11::detail::atomic_load(&freed_count));
+
+		min11::detail::atomic_store(&release, 1);
+		parked.join();
+		for (int ii = 0; ii < 3; ++ii)
+			domain.reclaim();
+		CHECK(10 == min11::detail::atomic_load(&freed_count));
+	}
+
+	// an exited thread's record, and what it retired, pass to the next
+	// thread instead of waiting for the domain's destruction
+	{
+		min11::epoch_domain domain;
+		min11::detail::atomic_store(&freed_count, 0);
+		min11::detail::atomic_store(&nodes[0].freed, 0);
+
+		retire_and_exit r = {&domain, &nodes[0]};
+		min11::thread first(r);
+		first.join();
+		CHECK(0 == min11::detail::atomic_load(&freed_count));
+
+		reclaim_thrice c = {&domain};
+		min11::thread second(c);
+		second.join();
+		CHECK(1 == min11::detail::atomic_load(&freed_count));
+	}
+
+	// concurrent writers retire nodes that concurrent readers still see
+	{
+		for (int ii = 0; ii < node_count; ++ii)
+			min11::detail::atomic_store(&nodes[ii].freed, 0);
+		min11::detail::atomic_store(&freed_count, 0);
+
+		{
+			min11::epoch_domain domain(8);
+			shared s = {&domain, &nodes[0], 1, 2, 1};
+			writer w = {&s};
+			reader r = {&s};
+			min11::thread r0(r);
+			min11::thread r1(r);
+			min11::thread w0(w);
+			min11::thread w1(w);
+			w0.join();
+			w1.join();
+			r0.join();
+			r1.join();
+
+			CHECK(1 == s.ok);
+		}
+
+		// the rest are freed with the domain
+		CHECK(2 * swaps_per_writer == min11::detail::atomic_load(&freed_count));
+	}
+
+	return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/config.h>
+
+#if MIN11_HAS_FIBERS
+
+#include <min11/condition_variable.h>
+#include <min11/fiber.h>
+#include <min11/mutex.h>
+#include <min11/thread.h>
+
+namespace
+{
+	struct shared
+	{
+		min11::mutex mtx;
+		min11::condition_variable cond;
+		int value;
+		int done;
+	};
+
+	// wait for `value' to reach `target', then bump it
+	struct waiter
+	{
+		shared* s;
+		int target;
+
+		void operator()()
+		{
+			min11::unique_lock<min11::mutex> lock(s->mtx);
+			while (s->value < target)
+				s->cond.wait(lock);
+			++s->value;
+			++s->done;
+			s->cond.notify_all();
+		}
+	};
+
+	struct setter
+	{
+		shared* s;
+		bool all;
+
+		void operator()()
+		{
+			min11::unique_lock<min11::mutex> lock(s->mtx);
+			s->value = 1;
+			if (all)
+				s->cond.notify_all();
+			else
+				s->cond.notify_one();
+		}
+	};
+
+	template<typename M>
+	struct guarded
+	{
+		M mtx;
+		int value;
+	};
+
+	// hold the lock across a reschedule, so the other fiber finds it
+	// taken. Only safe with a single worker, as the fiber resumes on the
+	// thread that locked it.
+	template<typename M>
+	struct holder
+	{
+		guarded<M>* g;
+
+		void operator()()
+		{
+			min11::unique_lock<M> lock(g->mtx);
+			min11::this_fiber::yield();
+			min11::this_fiber::yield();
+			++g->value;
+		}
+	};
+
+	template<typename M>
+	struct contender
+	{
+		guarded<M>* g;
+
+		void operator()()
+		{
+			min11::unique_lock<M> lock(g->mtx);
+			g->value *= 10;
+		}
+	};
+
+	// a fiber finding the mutex locked lets the holder run
+	template<typename M>
+	void test_contended_lock()
+	{
+		guarded<M> g;
+		g.value = 0;
+		{
+			min11::fiber_scheduler scheduler(1);
+			holder<M> h = {&g};
+			contender<M> c = {&g};
+			scheduler.post(h);
+			scheduler.post(c);
+		}
+		CHECK(g.value == 10);
+	}
+
+	struct counter
+	{
+		shared* s;
+
+		void operator()()
+		{
+			for (int ii = 0; ii < 1000; ++ii)
+			{
+				{
+					min11::unique_lock<min11::mutex> lock(s->mtx);
+					++s->value;
+				}
+
+				// with two workers a fiber may resume on the other one,
+				// so it never yields while holding the lock
+				if (0 == ii % 100)
+					min11::this_fiber::yield();
+			}
+		}
+	};
+}
+
+int main()
+{
+	// a fiber waiting on a condition variable lets the fiber that will
+	// notify it run on the same worker
+	{
+		shared s;
+		s.value = 0;
+		s.done = 0;
+		{
+			min11::fiber_scheduler scheduler(1);
+			waiter w = {&s, 1};
+			setter t = {&s, false};
+			scheduler.post(w);
+			scheduler.post(t);
+		}
+		CHECK(s.value == 2);
+		CHECK(s.done == 1);
+	}
+
+	test_contended_lock<min11::mutex>();
+	test_contended_lock<min11::pi_mutex>();
+
+	// a chain of fibers, each waiting for the previous one, released by
+	// a thread outside the scheduler; then a thread waiting for fibers
+	{
+		shared s;
+		s.value = 0;
+		s.done = 0;
+		{
+			min11::fiber_scheduler scheduler(2);
+			for (int ii = 20; ii > 0; --ii)
+			{
+				waiter w = {&s, ii};
+				scheduler.post(w);
+			}
+
+			setter t = {&s, true};
+			min11::thread th(t);
+			th.join();
+
+			min11::unique_lock<min11::mutex> lock(s.mtx);
+			while (s.done < 20)
+				s.cond.wait(lock);
+		}
+		CHECK(s.value == 21);
+	}
+
+	// contended increments from many fibers are not lost
+	{
+		shared s;
+		s.value = 0;
+		{
+			min11::fiber_scheduler scheduler(2);
+			for (int ii = 0; ii < 8; ++ii)
+			{
+				counter c = {&s};
+				scheduler.post(c);
+			}
+		}
+		CHECK(s.value == 8000);
+	}
+
+	return 0;
+}
+
+#else
+
+int main()
+{
+	return 0;
+}
+
+#endif // MIN11_HAS_FIBERS
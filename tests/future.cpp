@@ -0,0 +1,122 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/future.h>
+#include <min11/thread.h>
+
+namespace
+{
+	struct reader
+	{
+		min11::shared_future<int> future;
+		volatile long* mismatches;
+
+		void operator()()
+		{
+			for (int ii = 0; ii < 10000; ++ii)
+			{
+				if (future.get() != 42)
+					min11::detail::atomic_fetch_add(mismatches, 1);
+			}
+		}
+	};
+
+	struct failure
+	{
+	};
+}
+
+int main()
+{
+	// a unique future's ready value can be taken once
+	{
+		min11::promise<int> p;
+		min11::future<int> f(p.get_future());
+		p.set_value(7);
+
+		CHECK(f.valid());
+		CHECK(f.get() == 7);
+		CHECK(!f.valid());
+
+		bool threw = false;
+		try
+		{
+			f.get();
+		}
+		catch (const min11::future_error&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// a ready exception is rethrown to every shared reader
+	{
+		min11::promise<void> p;
+		min11::shared_future<void> f = p.get_future().share();
+		p.set_exception(failure());
+
+		for (int ii = 0; ii < 2; ++ii)
+		{
+			bool threw = false;
+			try
+			{
+				f.get();
+			}
+			catch (const failure&)
+			{
+				threw = true;
+			}
+			CHECK(threw);
+		}
+	}
+
+	// many readers of one ready shared_future, some arriving before it
+	// is set
+	{
+		min11::promise<int> p;
+		min11::shared_future<int> f = p.get_future().share();
+		volatile long mismatches = 0;
+
+		reader r = {f, &mismatches};
+		min11::thread a(r);
+		min11::thread b(r);
+		p.set_value(42);
+		min11::thread c(r);
+		min11::thread d(r);
+		a.join();
+		b.join();
+		c.join();
+		d.join();
+
+		CHECK(mismatches == 0);
+		CHECK(f.get() == 42);
+	}
+
+	return 0;
+}
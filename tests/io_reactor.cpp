@@ -0,0 +1,110 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/io_reactor.h>
+#include <min11/thread.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+	struct run_reactor
+	{
+		min11::io_reactor* reactor;
+
+		void operator()() const
+		{
+			reactor->run();
+		}
+	};
+}
+
+int main()
+{
+	// a regression blocks in read(2) or dies of SIGPIPE instead of
+	// failing a check
+	alarm(30);
+
+	min11::io_reactor reactor;
+	run_reactor body = {&reactor};
+	min11::thread runner(body);
+
+	char buf[8];
+
+	// complete an operation through epoll, then close the descriptors
+	int first[2];
+	CHECK(0 == pipe(first));
+	{
+		min11::future<min11::io_result> f(reactor.async_read(first[0], buf, sizeof(buf)));
+		CHECK(1 == write(first[1], "x", 1));
+		const min11::io_result r = f.get();
+		CHECK(r.bytes == 1 && r.error == 0);
+	}
+	{
+		min11::future<min11::io_result> f(reactor.async_write(first[1], "y", 1));
+		CHECK(f.get().bytes == 1);
+	}
+	reactor.cancel(first[0]);
+	reactor.cancel(first[1]);
+	close(first[0]);
+	close(first[1]);
+
+	// a new pipe reuses the cancelled numbers: it must still be made
+	// non-blocking and registered with epoll afresh
+	int second[2];
+	CHECK(0 == pipe(second));
+	CHECK(second[0] == first[0] && second[1] == first[1]);
+	{
+		min11::future<min11::io_result> f(reactor.async_read(second[0], buf, sizeof(buf)));
+		CHECK(2 == write(second[1], "ab", 2));
+		const min11::io_result r = f.get();
+		CHECK(r.error == 0 && r.bytes == 2 && 0 == memcmp(buf, "ab", 2));
+	}
+	reactor.cancel(second[0]);
+	reactor.cancel(second[1]);
+	close(second[0]);
+	close(second[1]);
+
+	// a socket reusing a pipe's number is written with MSG_NOSIGNAL
+	int pair[2];
+	CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, pair));
+	CHECK(pair[1] == first[1]);
+	close(pair[0]);
+	{
+		min11::future<min11::io_result> f(reactor.async_write(pair[1], "z", 1));
+		CHECK(f.get().error == EPIPE);
+	}
+	close(pair[1]);
+
+	reactor.stop();
+	runner.join();
+	return 0;
+}
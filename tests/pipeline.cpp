@@ -0,0 +1,168 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/pipeline.h>
+#include <min11/thread.h>
+#include <min11/thread_pool.h>
+
+#include <vector>
+
+namespace
+{
+	struct shared
+	{
+		int produced;
+		int limit;
+		volatile long in_flight;
+		long max_in_flight;
+		volatile long inside;
+		std::vector<int> output;
+		bool ok;
+	};
+
+	// produce 0, 1, ... up to `limit' items
+	struct input
+	{
+		shared* s;
+
+		bool operator()(int& item) const
+		{
+			if (s->produced == s->limit)
+				return false;
+
+			item = s->produced++;
+			const long n = min11::detail::atomic_fetch_add(&s->in_flight, 1) + 1;
+			if (n > s->max_in_flight)
+				s->max_in_flight = n;
+			return true;
+		}
+	};
+
+	// parallel work taking uneven time, so items overtake each other
+	struct square
+	{
+		void operator()(int& item) const
+		{
+			if (item % 3 == 0)
+				min11::this_thread::yield();
+			item = item * item;
+		}
+	};
+
+	// serial stage checking that no two items are inside it at once
+	struct exclusive
+	{
+		shared* s;
+
+		void operator()(int&) const
+		{
+			if (0 != min11::detail::atomic_exchange(&s->inside, 1))
+				s->ok = false;
+			min11::this_thread::yield();
+			min11::detail::atomic_store(&s->inside, 0);
+		}
+	};
+
+	struct collect
+	{
+		shared* s;
+
+		void operator()(int& item) const
+		{
+			s->output.push_back(item);
+			min11::detail::atomic_fetch_add(&s->in_flight, -1);
+		}
+	};
+
+	void reset(shared& s, int limit)
+	{
+		s.produced = 0;
+		s.limit = limit;
+		s.in_flight = 0;
+		s.max_in_flight = 0;
+		s.inside = 0;
+		s.output.clear();
+		s.ok = true;
+	}
+}
+
+int main()
+{
+	min11::thread_pool pool(4);
+
+	shared s;
+	input in = {&s};
+	exclusive ex = {&s};
+	collect out = {&s};
+
+	min11::pipeline<int> p(in);
+	p.add_stage(min11::pipeline<int>::parallel, square());
+	p.add_stage(min11::pipeline<int>::serial_out_of_order, ex);
+	p.add_stage(min11::pipeline<int>::serial_in_order, out);
+	CHECK(p.size() == 4);
+
+	// the in-order stage sees items in input order, serial stages run
+	// one item at a time, and no more than `max_tokens' are in flight
+	{
+		reset(s, 500);
+		p.run(pool, 4);
+
+		CHECK(s.ok);
+		CHECK(s.max_in_flight >= 1 && s.max_in_flight <= 4);
+		CHECK(s.output.size() == 500);
+		for (int ii = 0; ii < 500; ++ii)
+			CHECK(s.output[ii] == ii * ii);
+	}
+
+	// more tokens than items: the tokens left waiting at the input once
+	// it is exhausted retire, and the run still finishes
+	{
+		reset(s, 3);
+		p.run(pool, 16);
+
+		CHECK(s.output.size() == 3);
+		CHECK(s.output[0] == 0 && s.output[1] == 1 && s.output[2] == 4);
+	}
+
+	// an empty input ends the run at once
+	{
+		reset(s, 0);
+		p.run(pool, 8);
+		CHECK(s.output.empty());
+	}
+
+	// a single token runs the whole stream
+	{
+		reset(s, 50);
+		p.run(pool, 1);
+		CHECK(s.max_in_flight == 1);
+		CHECK(s.output.size() == 50 && s.output[49] == 49 * 49);
+	}
+
+	return 0;
+}
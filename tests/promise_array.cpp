@@ -0,0 +1,182 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/promise_array.h>
+#include <min11/thread.h>
+
+#include <stddef.h> // offsetof
+
+namespace
+{
+	struct copy_failed
+	{
+	};
+
+	// value whose copy throws when asked to
+	struct fragile
+	{
+		fragile(int value, bool throws)
+			: value(value)
+			, throws(throws)
+		{
+		}
+
+		fragile(const fragile& rhs)
+			: value(rhs.value)
+			, throws(false)
+		{
+			if (rhs.throws)
+				throw copy_failed();
+		}
+
+		int value;
+		bool throws;
+	};
+
+	// alignment of long double, the strictest fundamental type here
+	struct long_double_probe
+	{
+		char c;
+		long double d;
+	};
+
+	// attempt to set `index', reporting whether it threw future_error
+	bool set_throws(min11::promise_array<int>& promises, size_t index, int value)
+	{
+		try
+		{
+			promises.set_value(index, value);
+		}
+		catch (const min11::future_error&)
+		{
+			return true;
+		}
+
+		return false;
+	}
+
+	struct racer
+	{
+		min11::promise_array<int>* promises;
+		volatile long* rejected;
+
+		void operator()()
+		{
+			for (size_t ii = 0; ii < promises->size(); ++ii)
+			{
+				if (set_throws(*promises, ii, static_cast<int>(ii)))
+					min11::detail::atomic_fetch_add(rejected, 1);
+			}
+		}
+	};
+}
+
+int main()
+{
+	// setting an element twice, or past the end, is rejected
+	{
+		min11::promise_array<int> promises(4);
+		min11::future_array<int> futures = promises.get_futures();
+
+		CHECK(!set_throws(promises, 1, 10));
+		CHECK(set_throws(promises, 1, 20));
+		CHECK(set_throws(promises, 4, 30));
+		CHECK(set_throws(promises, static_cast<size_t>(-1), 30));
+
+		CHECK(futures.ready_count() == 1);
+		CHECK(futures.get(1) == 10);
+		CHECK(futures.completed_index(0) == 1);
+
+		for (size_t ii = 0; ii < 4; ++ii)
+		{
+			if (ii != 1)
+				promises.set_value(ii, static_cast<int>(ii));
+		}
+
+		CHECK(futures.ready_count() == 4);
+		CHECK(set_throws(promises, 3, 40));
+		CHECK(futures.ready_count() == 4);
+	}
+
+	// a value that fails to copy leaves the element unset
+	{
+		min11::promise_array<fragile> promises(2);
+		min11::future_array<fragile> futures = promises.get_futures();
+
+		bool threw = false;
+		try
+		{
+			promises.set_value(0, fragile(1, true));
+		}
+		catch (const copy_failed&)
+		{
+			threw = true;
+		}
+
+		CHECK(threw);
+		CHECK(!futures.is_ready(0));
+		CHECK(futures.ready_count() == 0);
+
+		promises.set_value(0, fragile(2, false));
+		CHECK(futures.is_ready(0));
+		CHECK(futures.get(0).value == 2);
+	}
+
+	// every element is aligned for the strictest fundamental type
+	{
+		const size_t alignment = offsetof(long_double_probe, d);
+		min11::promise_array<long double> promises(3);
+		min11::future_array<long double> futures = promises.get_futures();
+		for (size_t ii = 0; ii < 3; ++ii)
+		{
+			promises.set_value(ii, static_cast<long double>(ii));
+			CHECK(0 == reinterpret_cast<size_t>(&futures.get(ii)) % alignment);
+		}
+	}
+
+	// concurrent setters of the same elements: exactly one wins each
+	{
+		const size_t count = 1000;
+		min11::promise_array<int> promises(count);
+		min11::future_array<int> futures = promises.get_futures();
+		volatile long rejected = 0;
+
+		racer r = {&promises, &rejected};
+		min11::thread a(r);
+		min11::thread b(r);
+		a.join();
+		b.join();
+
+		CHECK(rejected == static_cast<long>(count));
+		CHECK(futures.ready_count() == count);
+		for (size_t ii = 0; ii < count; ++ii)
+			CHECK(futures.get(ii) == static_cast<int>(ii));
+	}
+
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/mutex.h>
+#include <min11/queue_lock.h>
+#include <min11/thread.h>
+
+namespace
+{
+	enum
+	{
+		thread_count = 4,
+		increments = 10000,
+		queued_count = 3
+	};
+
+	template<typename Lock>
+	struct shared
+	{
+		Lock lock;
+		volatile long inside;
+		long counter;
+		volatile long started;
+		int order[queued_count];
+		int acquired;
+		bool ok;
+	};
+
+	// increment a plain counter, checking nobody else is inside
+	template<typename Lock>
+	struct incrementer
+	{
+		shared<Lock>* s;
+
+		void operator()() const
+		{
+			for (int ii = 0; ii < increments; ++ii)
+			{
+				min11::unique_lock<Lock> lock(s->lock);
+				if (0 != min11::detail::atomic_exchange(&s->inside, 1))
+					s->ok = false;
+				++s->counter;
+				min11::detail::atomic_store(&s->inside, 0);
+			}
+		}
+	};
+
+	// queue up behind the holder and record when the lock is granted
+	template<typename Lock>
+	struct queued
+	{
+		shared<Lock>* s;
+		int id;
+
+		void operator()() const
+		{
+			min11::detail::atomic_fetch_add(&s->started, 1);
+			min11::unique_lock<Lock> lock(s->lock);
+			s->order[s->acquired++] = id;
+		}
+	};
+
+	template<typename Lock>
+	void test_lock()
+	{
+		// try_lock fails only while the lock is held
+		{
+			Lock lock;
+			CHECK(lock.try_lock());
+			CHECK(!lock.try_lock());
+			lock.unlock();
+			CHECK(lock.try_lock());
+			lock.unlock();
+		}
+
+		// mutual exclusion
+		{
+			shared<Lock> s;
+			s.inside = 0;
+			s.counter = 0;
+			s.ok = true;
+
+			incrementer<Lock> f = {&s};
+			min11::thread t0(f);
+			min11::thread t1(f);
+			min11::thread t2(f);
+			min11::thread t3(f);
+			t0.join();
+			t1.join();
+			t2.join();
+			t3.join();
+
+			CHECK(s.ok);
+			CHECK(s.counter == thread_count * increments);
+		}
+
+		// waiters are granted the lock in the order they queued
+		{
+			shared<Lock> s;
+			s.started = 0;
+			s.acquired = 0;
+			s.lock.lock();
+
+			queued<Lock> q0 = {&s, 0};
+			queued<Lock> q1 = {&s, 1};
+			queued<Lock> q2 = {&s, 2};
+
+			// give each thread time to reach the queue before the next
+			min11::thread t0(q0);
+			while (min11::detail::atomic_load(&s.started) != 1)
+				min11::this_thread::yield();
+			min11::detail::sleep_milliseconds(50);
+
+			min11::thread t1(q1);
+			while (min11::detail::atomic_load(&s.started) != 2)
+				min11::this_thread::yield();
+			min11::detail::sleep_milliseconds(50);
+
+			min11::thread t2(q2);
+			while (min11::detail::atomic_load(&s.started) != 3)
+				min11::this_thread::yield();
+			min11::detail::sleep_milliseconds(50);
+
+			s.lock.unlock();
+			t0.join();
+			t1.join();
+			t2.join();
+
+			CHECK(s.acquired == queued_count);
+			CHECK(s.order[0] == 0 && s.order[1] == 1 && s.order[2] == 2);
+		}
+	}
+}
+
+int main()
+{
+	test_lock<min11::ticket_lock>();
+	test_lock<min11::mcs_lock>();
+
+	// a thread may hold several mcs_locks, released in any order
+	{
+		min11::mcs_lock a;
+		min11::mcs_lock b;
+		a.lock();
+		b.lock();
+		a.unlock();
+		CHECK(a.try_lock());
+		b.unlock();
+		a.unlock();
+	}
+
+	return 0;
+}
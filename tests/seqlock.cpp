@@ -0,0 +1,138 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/seqlock.h>
+#include <min11/thread.h>
+
+namespace
+{
+	enum
+	{
+		word_count = 64,
+		write_count = 500000
+	};
+
+	// many words wide, so a write takes long enough for reads to overlap
+	// it and see a mix of old and new words
+	struct wide
+	{
+		long words[word_count];
+	};
+
+	wide make_wide(long value)
+	{
+		wide w;
+		for (int ii = 0; ii < word_count; ++ii)
+			w.words[ii] = value;
+		return w;
+	}
+
+	struct writer
+	{
+		min11::seqlock<wide>* lock;
+
+		void operator()() const
+		{
+			for (long ii = 1; ii <= write_count; ++ii)
+				lock->store(make_wide(ii));
+		}
+	};
+
+	// read until the last write is seen; every value returned must be
+	// whole and no older than the one before it
+	struct reader
+	{
+		min11::seqlock<wide>* lock;
+		volatile long* started;
+		bool* ok;
+
+		void operator()() const
+		{
+			min11::detail::atomic_fetch_add(started, 1);
+			long previous = 0;
+			while (previous != write_count)
+			{
+				const wide w = lock->load();
+				for (int ii = 1; ii < word_count; ++ii)
+				{
+					if (w.words[ii] != w.words[0])
+						*ok = false;
+				}
+
+				if (w.words[0] < previous)
+					*ok = false;
+				previous = w.words[0];
+			}
+		}
+	};
+
+	struct odd_size
+	{
+		char bytes[3];
+	};
+}
+
+int main()
+{
+	// values smaller than a word round trip
+	{
+		odd_size value = {{'a', 'b', 'c'}};
+		min11::seqlock<odd_size> lock(value);
+		odd_size copy;
+		CHECK(lock.try_load(copy));
+		CHECK(copy.bytes[0] == 'a' && copy.bytes[1] == 'b' && copy.bytes[2] == 'c');
+
+		value.bytes[1] = 'x';
+		lock.store(value);
+		CHECK(lock.load().bytes[1] == 'x');
+	}
+
+	// reads overlapping writes retry instead of returning a torn value
+	{
+		min11::seqlock<wide> lock;
+		CHECK(lock.load().words[word_count - 1] == 0);
+
+		volatile long started = 0;
+		bool ok[2] = {true, true};
+		reader r0 = {&lock, &started, &ok[0]};
+		reader r1 = {&lock, &started, &ok[1]};
+		min11::thread t0(r0);
+		min11::thread t1(r1);
+		while (min11::detail::atomic_load(&started) != 2)
+			min11::detail::cpu_relax();
+
+		writer w = {&lock};
+		w();
+
+		t0.join();
+		t1.join();
+		CHECK(ok[0] && ok[1]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/stop_token.h>
+
+namespace
+{
+	// deregisters itself from inside its own invocation
+	class self_detaching : public min11::detail::stop_callback_base
+	{
+	public:
+		explicit self_detaching(min11::detail::stop_state* state)
+			: min11::detail::stop_callback_base(&self_detaching::invoke_callback)
+			, state(state)
+			, slot(0)
+			, calls(0)
+		{
+		}
+
+		static void invoke_callback(min11::detail::stop_callback_base* base)
+		{
+			self_detaching* self = static_cast<self_detaching*>(base);
+			++self->calls;
+			self->state->detach(self->slot);
+		}
+
+		min11::detail::stop_state* state;
+		min11::detail::stop_slot* slot;
+		int calls;
+	};
+
+	struct count_call
+	{
+		int* calls;
+
+		void operator()() const
+		{
+			++*calls;
+		}
+	};
+}
+
+int main()
+{
+	using min11::detail::stop_slot;
+
+	// a slot deregistered by its own callback is released for reuse
+	{
+		min11::detail::stop_state* state = new min11::detail::stop_state;
+		self_detaching a(state);
+		self_detaching b(state);
+		a.slot = state->attach(&a);
+		b.slot = state->attach(&b);
+
+		CHECK(state->request_stop());
+		CHECK(a.calls == 1 && b.calls == 1);
+		CHECK(a.slot->state == stop_slot::unused);
+		CHECK(b.slot->state == stop_slot::unused);
+		state->dec_ref();
+	}
+
+	// deregistering before stop releases the slot for the next callback
+	{
+		min11::stop_source source;
+		int calls = 0;
+		count_call f = {&calls};
+		for (int ii = 0; ii < 100; ++ii)
+		{
+			min11::stop_callback<count_call> cb(source.get_token(), f);
+		}
+
+		min11::stop_callback<count_call> last(source.get_token(), f);
+		source.request_stop();
+		CHECK(calls == 1);
+	}
+
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/strand.h>
+#include <min11/thread.h>
+#include <min11/thread_pool.h>
+
+#include <vector>
+
+namespace
+{
+	enum
+	{
+		producer_count = 3,
+		steps_per_producer = 2000
+	};
+
+	// holds submitted tasks until the test runs them
+	class manual_executor
+	{
+	public:
+		manual_executor()
+			: submitted(0)
+		{
+		}
+
+		void submit(min11::detail::task* t)
+		{
+			tasks.push_back(t);
+			++submitted;
+		}
+
+		// run the oldest task; false if there was none
+		bool run_one()
+		{
+			if (tasks.empty())
+				return false;
+
+			min11::detail::task* t = tasks.front();
+			tasks.erase(tasks.begin());
+			t->run();
+			return true;
+		}
+
+		std::vector<min11::detail::task*> tasks;
+		int submitted;
+	};
+
+	struct record
+	{
+		std::vector<int>* order;
+		int value;
+
+		void operator()() const
+		{
+			order->push_back(value);
+		}
+	};
+
+	// state touched only from the strand's tasks
+	struct shared
+	{
+		volatile long inside;
+		int last[producer_count];
+		int ran;
+		bool ok;
+	};
+
+	struct step
+	{
+		shared* s;
+		int producer;
+		int seq;
+
+		void operator()() const
+		{
+			if (0 != min11::detail::atomic_exchange(&s->inside, 1))
+				s->ok = false;
+			if (s->last[producer] != seq - 1)
+				s->ok = false;
+			s->last[producer] = seq;
+			++s->ran;
+			min11::detail::atomic_store(&s->inside, 0);
+		}
+	};
+
+	struct producer
+	{
+		min11::strand<min11::thread_pool>* st;
+		shared* s;
+		int id;
+
+		void operator()() const
+		{
+			for (int ii = 0; ii < steps_per_producer; ++ii)
+			{
+				step f = {s, id, ii};
+				st->post(f);
+			}
+		}
+	};
+}
+
+int main()
+{
+	// tasks run in submission order, `batch' at a time before the strand
+	// resubmits itself
+	{
+		manual_executor ex;
+		min11::strand<manual_executor> st(ex, 4);
+		std::vector<int> order;
+		for (int ii = 0; ii < 10; ++ii)
+		{
+			record r = {&order, ii};
+			st.post(r);
+		}
+
+		// only the first post schedules the strand
+		CHECK(ex.submitted == 1);
+		CHECK(!st.idle());
+
+		CHECK(ex.run_one());
+		CHECK(order.size() == 4);
+		CHECK(ex.submitted == 2);
+
+		CHECK(ex.run_one());
+		CHECK(order.size() == 8);
+		CHECK(ex.submitted == 3);
+
+		// the last run drains the queue without resubmitting
+		CHECK(ex.run_one());
+		CHECK(order.size() == 10);
+		CHECK(ex.submitted == 3);
+		CHECK(!ex.run_one());
+		CHECK(st.idle());
+
+		for (int ii = 0; ii < 10; ++ii)
+			CHECK(order[ii] == ii);
+
+		// an idle strand is scheduled again by the next post
+		record r = {&order, 10};
+		st.post(r);
+		CHECK(ex.submitted == 4);
+		CHECK(ex.run_one());
+		CHECK(order.size() == 11 && order[10] == 10);
+	}
+
+	// tasks posted from several threads onto a pool never overlap, and
+	// each thread's tasks run in the order it posted them
+	{
+		min11::thread_pool pool(4);
+		min11::strand<min11::thread_pool> st(pool, 16);
+
+		shared s;
+		s.inside = 0;
+		s.ran = 0;
+		s.ok = true;
+		for (int ii = 0; ii < producer_count; ++ii)
+			s.last[ii] = -1;
+
+		producer p0 = {&st, &s, 0};
+		producer p1 = {&st, &s, 1};
+		producer p2 = {&st, &s, 2};
+		min11::thread t0(p0);
+		min11::thread t1(p1);
+		min11::thread t2(p2);
+		t0.join();
+		t1.join();
+		t2.join();
+
+		while (!st.idle())
+			min11::this_thread::yield();
+
+		CHECK(s.ok);
+		CHECK(s.ran == producer_count * steps_per_producer);
+		for (int ii = 0; ii < producer_count; ++ii)
+			CHECK(s.last[ii] == steps_per_producer - 1);
+	}
+
+	return 0;
+}
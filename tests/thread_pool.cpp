@@ -0,0 +1,124 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/future.h>
+#include <min11/mutex.h>
+#include <min11/thread_pool.h>
+#include <min11/thread_specific_ptr.h>
+
+namespace
+{
+	struct stats
+	{
+		min11::mutex mtx;
+		int deepest; // most chain links nested on one worker's stack
+		int finished;
+	};
+
+	min11::thread_specific_ptr<int> nesting;
+
+	// one link of a chain: runs the next link and waits for it, so
+	// every link but the last waits while nested in the pool
+	struct link
+	{
+		min11::thread_pool* pool;
+		stats* s;
+		int index;
+		int length;
+		min11::promise<void>* done;
+
+		void operator()()
+		{
+			if (!nesting.get())
+				nesting.reset(new int(0));
+			const int depth = ++*nesting;
+			{
+				min11::unique_lock<min11::mutex> lock(s->mtx);
+				if (depth > s->deepest)
+					s->deepest = depth;
+			}
+
+			if (index + 1 < length)
+			{
+				min11::promise<void>* next = new min11::promise<void>;
+				min11::future<void> f(next->get_future());
+				link child = {pool, s, index + 1, length, next};
+				pool->post(child);
+				f.get();
+			}
+
+			--*nesting;
+			{
+				min11::unique_lock<min11::mutex> lock(s->mtx);
+				++s->finished;
+			}
+
+			// the waiter may destroy its future as soon as this is set
+			done->set_value();
+			delete done;
+		}
+	};
+
+	void run_chain(unsigned workers, int length, stats* s)
+	{
+		s->deepest = 0;
+		s->finished = 0;
+
+		min11::thread_pool pool(workers);
+		min11::promise<void>* first = new min11::promise<void>;
+		min11::future<void> f(first->get_future());
+		link head = {&pool, s, 0, length, first};
+		pool.post(head);
+		f.get();
+	}
+}
+
+int main()
+{
+	const int limit = min11::thread_pool::help_depth_limit;
+
+	// a worker helps while waiting, running a chain shallower than the
+	// limit on its own stack
+	{
+		stats s;
+		run_chain(1, limit, &s);
+		CHECK(s.finished == limit);
+		CHECK(s.deepest == limit);
+	}
+
+	// past the limit a worker blocks, leaving deeper links to the
+	// other worker
+	{
+		stats s;
+		run_chain(2, 3 * limit / 2, &s);
+		CHECK(s.finished == 3 * limit / 2);
+		CHECK(s.deepest <= limit + 1);
+	}
+
+	return 0;
+}
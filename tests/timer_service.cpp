@@ -0,0 +1,179 @@
+/*
+ * Copyright 2014 Matthew Endsley
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted providing that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check.h"
+
+#include <min11/timer_service.h>
+
+#include <vector>
+
+#if defined(__linux__)
+#	include <dirent.h>
+#	include <stdlib.h>
+#	include <string.h>
+#endif
+
+namespace
+{
+	struct record
+	{
+		min11::mutex* mtx;
+		std::vector<int>* order;
+		min11::timer_service::time_point* fired;
+		min11::timer_service::time_point not_before;
+		int id;
+
+		void operator()() const
+		{
+			const min11::timer_service::time_point now = min11::timer_service::now();
+			min11::unique_lock<min11::mutex> lock(*mtx);
+			order->push_back(id);
+			*fired = now;
+			CHECK(now >= not_before);
+		}
+	};
+
+	struct nothing
+	{
+		void operator()() const
+		{
+		}
+	};
+
+#if defined(__linux__)
+	// largest thread id in the process; threads here are created in order
+	long newest_thread()
+	{
+		long newest = 0;
+		DIR* dir = opendir("/proc/self/task");
+		CHECK(dir != NULL);
+		while (dirent* entry = readdir(dir))
+		{
+			const long tid = atol(entry->d_name);
+			if (tid > newest)
+				newest = tid;
+		}
+		closedir(dir);
+		return newest;
+	}
+
+	long voluntary_switches(long tid)
+	{
+		char path[64];
+		snprintf(path, sizeof(path), "/proc/self/task/%ld/status", tid);
+		FILE* f = fopen(path, "r");
+		CHECK(f != NULL);
+
+		long switches = -1;
+		char line[256];
+		while (fgets(line, sizeof(line), f))
+		{
+			if (0 == strncmp(line, "voluntary_ctxt_switches:", 24))
+				switches = atol(line + 24);
+		}
+		fclose(f);
+		return switches;
+	}
+#endif
+}
+
+int main()
+{
+	min11::timer_service timers;
+
+	// timers fire in expiry order and never early, across wheel levels
+	{
+		min11::mutex mtx;
+		std::vector<int> order;
+		min11::timer_service::time_point fired = 0;
+		const min11::timer_service::time_point start = min11::timer_service::now();
+		const unsigned long delays[] = {600, 10, 300, 40};
+		for (int ii = 0; ii < 4; ++ii)
+		{
+			record r = {&mtx, &order, &fired, start + delays[ii], static_cast<int>(delays[ii])};
+			timers.schedule_at(start + delays[ii], r);
+		}
+
+		min11::future<void> done(timers.after(700));
+		done.wait();
+
+		min11::unique_lock<min11::mutex> lock(mtx);
+		CHECK(order.size() == 4);
+		CHECK(order[0] == 10 && order[1] == 40 && order[2] == 300 && order[3] == 600);
+	}
+
+	// a thread sleeping towards a distant timer wakes for an earlier one
+	{
+		min11::timer_service::timer far = timers.schedule_after(60000, nothing());
+
+		const min11::timer_service::time_point start = min11::timer_service::now();
+		min11::future<void> soon(timers.after(50));
+		soon.wait();
+		CHECK(min11::timer_service::now() - start < 1000);
+
+		CHECK(timers.cancel(far));
+	}
+
+	// destroying the service breaks the promises of pending after() calls
+	{
+		min11::future<void>* pending;
+		{
+			min11::timer_service doomed;
+			pending = new min11::future<void>(doomed.after(60000));
+		}
+
+		bool threw = false;
+		try
+		{
+			pending->get();
+		}
+		catch (const min11::future_error&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+		delete pending;
+	}
+
+#if defined(__linux__)
+	// a distant timer does not make the thread poll every tick
+	{
+		min11::timer_service idle;
+		const long tid = newest_thread();
+		min11::timer_service::timer far = idle.schedule_after(60000, nothing());
+		min11::detail::sleep_milliseconds(50);
+
+		const long before = voluntary_switches(tid);
+		min11::detail::sleep_milliseconds(1000);
+		const long after = voluntary_switches(tid);
+		CHECK(before >= 0 && after - before < 10);
+
+		CHECK(idle.cancel(far));
+	}
+#endif
+
+	return 0;
+}